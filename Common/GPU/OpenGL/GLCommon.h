@@ -18,7 +18,13 @@
 #include <OpenGL/gl3.h>
 #include <OpenGL/gl3ext.h>
 #else
+// PPSSPPHeadless on Linux. It links GLVND's libGL, which exports every core and
+// extension entry point the GL backend uses, so the prototypes are enough, no loader.
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES
+#endif
 #include <GL/gl.h>
+#include <GL/glext.h>
 #endif
 #endif
 
@@ -96,6 +102,7 @@ extern PFNGLISVERTEXARRAYOESPROC glIsVertexArrayOES;
 #endif
 
 
+#if defined(__APPLE__)
 // OpenEmu workaraounds for limitations in Apple's OpenGL
 #define GL_COMPUTE_SHADER 0x91B9
 #define GL_DEBUG_SOURCE_APPLICATION 0x824A
@@ -106,3 +113,4 @@ static void  (*glBufferStorage) (GLenum target, GLsizeiptr size, const void *dat
 static void (*glGetTextureSubImage)(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, GLsizei bufSize, void *pixels) = 0;
 static void (*glPushDebugGroup)(GLenum source, GLuint id, GLsizei length, const char * message) = 0;
 static void (*glPopDebugGroup)(void) = 0;
+#endif
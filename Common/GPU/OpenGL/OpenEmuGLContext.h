@@ -29,6 +29,8 @@ public:
           DestroyDrawContext();
     }
     void SwapInterval(int interval) override;
+    // Emu thread. The render manager switches over at its next BeginFrame.
+    void SetInflightFrames(int frames) { renderManager_->SetInflightFrames(frames); }
     void Resize() override {}
     void SwapBuffers() override {}
     
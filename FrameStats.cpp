@@ -0,0 +1,65 @@
+#include "FrameStats.h"
+
+#include <cmath>
+#include <cstring>
+
+void FrameTimeHistogram::Add(double ms) {
+    if (ms < 0.0)
+        ms = 0.0;
+
+    int bucket = (int)(ms * BUCKETS_PER_MS);
+    if (bucket >= NUM_BUCKETS)
+        bucket = NUM_BUCKETS - 1;
+    buckets_[bucket]++;
+
+    if (count_ == 0 || ms < min_)
+        min_ = ms;
+    if (count_ == 0 || ms > max_)
+        max_ = ms;
+    count_++;
+    sum_ += ms;
+    sumSq_ += ms * ms;
+}
+
+void FrameTimeHistogram::Reset() {
+    memset(buckets_, 0, sizeof(buckets_));
+    count_ = 0;
+    sum_ = 0.0;
+    sumSq_ = 0.0;
+    min_ = 0.0;
+    max_ = 0.0;
+}
+
+double FrameTimeHistogram::Mean() const {
+    return count_ ? sum_ / count_ : 0.0;
+}
+
+double FrameTimeHistogram::StdDev() const {
+    if (count_ < 2)
+        return 0.0;
+    double mean = Mean();
+    double variance = sumSq_ / count_ - mean * mean;
+    return variance > 0.0 ? sqrt(variance) : 0.0;
+}
+
+double FrameTimeHistogram::Percentile(double p) const {
+    if (count_ == 0)
+        return 0.0;
+
+    uint64_t target = (uint64_t)ceil(count_ * p / 100.0);
+    if (target == 0)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        seen += buckets_[i];
+        if (seen >= target) {
+            // The overflow bucket has no upper edge, the max is the best we have.
+            if (i == NUM_BUCKETS - 1)
+                return max_;
+            double edge = (double)(i + 1) / BUCKETS_PER_MS;
+            return edge < max_ ? edge : max_;
+        }
+    }
+    return max_;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+// Fixed resolution histogram of durations in milliseconds. Cheap enough to
+// update once per frame from the emu or render thread, and keeps enough
+// information around for percentile reporting. Not thread safe: one writer,
+// read it from the same thread or once the writer is idle.
+class FrameTimeHistogram {
+public:
+    static const int BUCKETS_PER_MS = 20;  // 50 us resolution
+    static const int MAX_MS = 200;
+    static const int NUM_BUCKETS = MAX_MS * BUCKETS_PER_MS + 1;  // The last one catches everything above MAX_MS.
+
+    FrameTimeHistogram() { Reset(); }
+
+    void Add(double ms);
+    void Reset();
+
+    uint32_t Count() const { return count_; }
+    double Sum() const { return sum_; }
+    double Mean() const;
+    double StdDev() const;
+    double Min() const { return count_ ? min_ : 0.0; }
+    double Max() const { return count_ ? max_ : 0.0; }
+    // p in [0, 100]. Returns the upper edge of the bucket the percentile falls in.
+    double Percentile(double p) const;
+
+private:
+    uint32_t buckets_[NUM_BUCKETS];
+    uint32_t count_;
+    double sum_;
+    double sumSq_;
+    double min_;
+    double max_;
+};
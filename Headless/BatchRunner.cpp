@@ -0,0 +1,353 @@
+#include "BatchRunner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Common/Data/Format/JSONReader.h"
+#include "Common/Data/Format/JSONWriter.h"
+#include "Common/TimeUtil.h"
+
+extern char **environ;
+
+struct BatchOptions {
+    int jobs = 0;
+    std::string report;
+    std::string baseline;
+    double thresholdPercent = 5.0;
+    // Handed to every child as is.
+    std::vector<std::string> passthrough;
+    std::vector<std::string> images;
+};
+
+struct RunResult {
+    std::string image;
+    bool ok = false;
+    int exitCode = -1;
+    double wallSeconds = 0.0;
+    // Metrics from the child's JSON, see PrintJson in HeadlessMain.cpp.
+    std::map<std::string, double> metrics;
+};
+
+// Metrics compared against the baseline, and whether higher is better.
+static const struct {
+    const char *name;
+    bool higherIsBetter;
+} compared[] = {
+    { "fps", true },
+    { "emulatedFps", true },
+    { "meanMs", false },
+    { "p90Ms", false },
+    { "p99Ms", false },
+    { "peakRssMb", false },
+};
+
+static const char *const metricNames[] = {
+    "frames", "elapsedSeconds", "fps", "emulatedFps", "meanMs", "stddevMs", "minMs", "maxMs", "p50Ms", "p90Ms", "p99Ms", "p999Ms", "startupMs",
+    "drawCallsPerFrame", "flushesPerFrame", "peakRssMb",
+};
+
+static bool ParseBatchArgs(int argc, const char *argv[], BatchOptions *options) {
+    // argv[1] is --batch.
+    for (int i = 2; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "--jobs") && hasValue) {
+            options->jobs = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--report") && hasValue) {
+            options->report = argv[++i];
+        } else if (!strcmp(arg, "--baseline") && hasValue) {
+            options->baseline = argv[++i];
+        } else if (!strcmp(arg, "--threshold") && hasValue) {
+            options->thresholdPercent = atof(argv[++i]);
+        } else if (!strcmp(arg, "--list") && hasValue) {
+            std::ifstream list(argv[++i]);
+            if (!list) {
+                fprintf(stderr, "Can't read %s\n", argv[i]);
+                return false;
+            }
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty() && line[0] != '#')
+                    options->images.push_back(line);
+            }
+        } else if ((!strcmp(arg, "--frames") || !strcmp(arg, "--warmup") || !strcmp(arg, "--assets") ||
+                    !strcmp(arg, "--memstick") || !strcmp(arg, "--speed") || !strcmp(arg, "--thread-policy") ||
+                    !strcmp(arg, "--record-ge") || !strcmp(arg, "--record-movie") || !strcmp(arg, "--replay-movie") ||
+                    !strcmp(arg, "--memory-budget") || !strcmp(arg, "--run-ahead") ||
+                    !strcmp(arg, "--rewind")) && hasValue) {
+            options->passthrough.push_back(arg);
+            options->passthrough.push_back(argv[++i]);
+        } else if (!strcmp(arg, "--interpreter") || !strcmp(arg, "--jit-cache") || !strcmp(arg, "--gl")) {
+            options->passthrough.push_back(arg);
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "Unknown batch option %s\n", arg);
+            return false;
+        } else {
+            options->images.push_back(arg);
+        }
+    }
+
+    if (options->jobs <= 0)
+        options->jobs = std::max(1u, std::thread::hardware_concurrency());
+    return !options->images.empty();
+}
+
+static void ParseChildOutput(const std::string &output, RunResult *result) {
+    // The JSON object is the last line, anything before it is stray output from the core.
+    size_t start = output.rfind("\n{");
+    start = start == std::string::npos ? output.find('{') : start + 1;
+    if (start == std::string::npos)
+        return;
+
+    json::JsonReader reader(output.data() + start, output.size() - start);
+    if (!reader.ok())
+        return;
+    json::JsonGet root = reader.root();
+    for (const char *name : metricNames) {
+        if (root.get(name))
+            result->metrics[name] = root.getFloat(name);
+    }
+}
+
+// Held from pipe() to posix_spawn(), so no child inherits another run's pipe (which would
+// keep that run's read from seeing EOF until the wrong child exits).
+static std::mutex spawnLock;
+
+static RunResult RunChild(const std::string &self, const BatchOptions &options, const std::string &image) {
+    RunResult result;
+    result.image = image;
+
+    std::vector<std::string> args;
+    args.push_back(self);
+    args.insert(args.end(), options.passthrough.begin(), options.passthrough.end());
+    args.push_back("--json");
+    args.push_back(image);
+
+    std::vector<char *> argv;
+    for (std::string &arg : args)
+        argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+
+    std::unique_lock<std::mutex> lock(spawnLock);
+    int fds[2];
+    if (pipe(fds) != 0) {
+        fprintf(stderr, "pipe() failed for %s\n", image.c_str());
+        return result;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    // The child's stdout comes back to us, its logging on stderr goes straight through.
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+    double start = time_now_d();
+    pid_t pid;
+    // A bare name, if we couldn't find ourselves, gets looked up in PATH like the shell did.
+    int err = self.find('/') == std::string::npos
+        ? posix_spawnp(&pid, self.c_str(), &actions, nullptr, &argv[0], environ)
+        : posix_spawn(&pid, self.c_str(), &actions, nullptr, &argv[0], environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    lock.unlock();
+    if (err != 0) {
+        fprintf(stderr, "Failed to launch %s: %s\n", self.c_str(), strerror(err));
+        close(fds[0]);
+        return result;
+    }
+
+    std::string output;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fds[0], buffer, sizeof(buffer))) > 0)
+        output.append(buffer, count);
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    result.wallSeconds = time_now_d() - start;
+    result.exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    ParseChildOutput(output, &result);
+    result.ok = result.exitCode == 0 && !result.metrics.empty();
+    return result;
+}
+
+static bool LoadBaseline(const std::string &filename, std::map<std::string, std::map<std::string, double>> *baseline) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+        return false;
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    json::JsonReader reader(data.data(), data.size());
+    if (!reader.ok())
+        return false;
+
+    const json::JsonNode *titles = reader.root().getArray("titles");
+    if (!titles)
+        return false;
+    for (const json::JsonNode *title : titles->value) {
+        json::JsonGet entry = title->value;
+        std::string image;
+        if (!entry.getString("image", &image))
+            continue;
+        for (const char *name : metricNames) {
+            if (entry.get(name))
+                (*baseline)[image][name] = entry.getFloat(name);
+        }
+    }
+    return true;
+}
+
+// The jobs run this same binary. argv[0] is only a path when we weren't started from PATH.
+static std::string ExecutablePath(const char *argv0) {
+    char resolved[PATH_MAX];
+#if defined(__APPLE__)
+    char path[PATH_MAX];
+    uint32_t size = sizeof(path);
+    if (_NSGetExecutablePath(path, &size) == 0 && realpath(path, resolved))
+        return resolved;
+#elif defined(__linux__)
+    ssize_t length = readlink("/proc/self/exe", resolved, sizeof(resolved) - 1);
+    if (length > 0) {
+        resolved[length] = '\0';
+        return resolved;
+    }
+#endif
+    if (strchr(argv0, '/') && realpath(argv0, resolved))
+        return resolved;
+    return argv0;
+}
+
+int RunBatch(int argc, const char *argv[]) {
+    BatchOptions options;
+    if (!ParseBatchArgs(argc, argv, &options)) {
+        fprintf(stderr, "Usage: %s --batch [--jobs N] [--list FILE] [--report FILE] [--baseline FILE] [--threshold PCT] [options] <image>...\n", argv[0]);
+        return 2;
+    }
+
+    std::map<std::string, std::map<std::string, double>> baseline;
+    if (!options.baseline.empty() && !LoadBaseline(options.baseline, &baseline)) {
+        fprintf(stderr, "Can't read baseline %s\n", options.baseline.c_str());
+        return 2;
+    }
+
+    std::string self = ExecutablePath(argv[0]);
+
+    std::vector<RunResult> results(options.images.size());
+    std::atomic<size_t> next(0);
+    std::mutex printLock;
+    double start = time_now_d();
+
+    int jobs = std::min(options.jobs, (int)options.images.size());
+    std::vector<std::thread> workers;
+    for (int i = 0; i < jobs; i++) {
+        workers.emplace_back([&] {
+            size_t index;
+            while ((index = next++) < options.images.size()) {
+                results[index] = RunChild(self, options, options.images[index]);
+                std::lock_guard<std::mutex> guard(printLock);
+                const RunResult &result = results[index];
+                fprintf(stderr, "[%zu/%zu] %s: %s in %.1f s\n", index + 1, options.images.size(), result.image.c_str(),
+                    result.ok ? "ok" : "FAILED", result.wallSeconds);
+            }
+        });
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+
+    json::JsonWriter writer(json::JsonWriter::PRETTY);
+    writer.begin();
+    writer.writeInt("jobs", jobs);
+    writer.writeFloat("wallSeconds", time_now_d() - start);
+    writer.writeFloat("thresholdPercent", options.thresholdPercent);
+    if (!options.baseline.empty())
+        writer.writeString("baseline", options.baseline.c_str());
+
+    int failures = 0;
+    writer.pushArray("titles");
+    for (const RunResult &result : results) {
+        writer.pushDict();
+        writer.writeString("image", result.image.c_str());
+        writer.writeBool("ok", result.ok);
+        writer.writeInt("exitCode", result.exitCode);
+        writer.writeFloat("wallSeconds", result.wallSeconds);
+        for (const auto &metric : result.metrics)
+            writer.writeFloat(metric.first.c_str(), metric.second);
+        writer.pop();
+        if (!result.ok)
+            failures++;
+    }
+    writer.pop();
+
+    int regressions = 0;
+    writer.pushArray("regressions");
+    for (const RunResult &result : results) {
+        auto base = baseline.find(result.image);
+        if (!result.ok || base == baseline.end())
+            continue;
+
+        for (const auto &metric : compared) {
+            auto before = base->second.find(metric.name);
+            auto after = result.metrics.find(metric.name);
+            if (before == base->second.end() || after == result.metrics.end() || before->second == 0.0)
+                continue;
+
+            double change = (after->second - before->second) / before->second * 100.0;
+            double worse = metric.higherIsBetter ? -change : change;
+            if (worse <= options.thresholdPercent)
+                continue;
+
+            writer.pushDict();
+            writer.writeString("image", result.image.c_str());
+            writer.writeString("metric", metric.name);
+            writer.writeFloat("baseline", before->second);
+            writer.writeFloat("current", after->second);
+            writer.writeFloat("changePercent", change);
+            writer.pop();
+            regressions++;
+            fprintf(stderr, "REGRESSION %s %s: %.3f -> %.3f (%+.1f%%)\n", result.image.c_str(), metric.name, before->second, after->second, change);
+        }
+    }
+    writer.pop();
+    writer.end();
+
+    if (options.report.empty()) {
+        printf("%s\n", writer.str().c_str());
+    } else {
+        FILE *file = fopen(options.report.c_str(), "w");
+        if (!file) {
+            fprintf(stderr, "Can't write %s\n", options.report.c_str());
+            return 1;
+        }
+        fprintf(file, "%s\n", writer.str().c_str());
+        fclose(file);
+    }
+
+    fprintf(stderr, "%zu runs, %d failed, %d regressions\n", results.size(), failures, regressions);
+    if (failures)
+        return 1;
+    return regressions ? 3 : 0;
+}
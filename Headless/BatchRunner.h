@@ -0,0 +1,22 @@
+#pragma once
+
+// Regression matrix runner. Launches this same executable once per image with --json,
+// keeping up to --jobs of them running at a time (default: one per core), and merges
+// their results into a single JSON report. Every image gets its own process because the
+// core and the NativeApp glue are full of globals, one game per process is all they do.
+//
+//   PPSSPPHeadless --batch [options] <image>...
+//     --jobs N         parallel processes (default: number of cores)
+//     --list FILE      read more images from FILE, one path per line
+//     --report FILE    where to write the report (default: stdout)
+//     --baseline FILE  an earlier report to compare against
+//     --threshold PCT  flag changes worse than this (default 5)
+//     --frames, --warmup, --assets, --memstick, --interpreter, --speed, --thread-policy,
+//     --jit-cache, --gl, --record-ge, --record-movie, --replay-movie, --memory-budget,
+//     --run-ahead, --rewind
+//                      passed through to every run. A movie belongs to one game, so
+//                      the movie options only make sense with a single image
+//
+// Exit code is 0 if every run succeeded without regressions, 3 if any metric regressed
+// past the threshold and 1 if any run failed.
+int RunBatch(int argc, const char *argv[]);
@@ -0,0 +1,161 @@
+#include "HeadlessHost.h"
+
+#include "Common/GPU/OpenGL/GLCommon.h"
+#include "Common/GPU/OpenGL/OpenEmuGLContext.h"
+#include "Common/LogManager.h"
+#include "Common/System/NativeApp.h"
+
+#include "Core/Config.h"
+#include "Core/ConfigValues.h"
+#include "Core/Core.h"
+#include "Core/Host.h"
+#include "Core/System.h"
+#include "GPU/GPU.h"
+
+#include "NullGraphicsContext.h"
+#include "OffscreenGL.h"
+#include "OpenEmuCoreThread.h"
+#include "OpenEmuFileLoader.h"
+#include "OpenEmuJitCache.h"
+#include "OpenEmuShaderCache.h"
+#include "OpenEmuStartupTrace.h"
+
+static NullGraphicsContext *graphicsContext = nullptr;
+// Like the plugin's, it lives until the process exits.
+static OpenEmuGLContext *glContext = nullptr;
+static CoreParameter coreParam;
+static HeadlessGpuStats gpuTotals;
+
+bool HeadlessBoot(const HeadlessOptions &options, std::string *errorString) {
+    OpenEmuStartupTrace::Begin();
+    OpenEmuStartupTrace::SetTraceFile(options.startupTrace);
+    OpenEmuThreadPlacement::SetPolicy(options.threadPolicy);
+    OpenEmuJitCache::SetEnabled(options.jitCache);
+    // The software GPU has no shaders to track.
+    OpenEmuShaderCache::SetEnabled(options.glBackend);
+
+    g_Config.bEnableLogging = true;
+    LogManager::Init(&g_Config.bEnableLogging);
+
+    {
+        OpenEmuStartupTrace::ScopedStep step("Config load");
+        g_Config.Load("");
+    }
+    OpenEmuShaderCache::Configure();
+
+    std::string directory = options.memStickDirectory;
+    if (directory.empty() || directory.back() != '/')
+        directory += "/";
+
+    g_Config.currentDirectory        = Path(directory);
+    g_Config.defaultCurrentDirectory = Path(directory);
+    g_Config.memStickDirectory       = Path(directory);
+    g_Config.flash0Directory         = Path(directory);
+    g_Config.internalDataDirectory   = Path(directory);
+    g_Config.appCacheDirectory       = Path(directory + "cache/");
+    g_Config.iGPUBackend             = (int)GPUBackend::OPENGL;
+    g_Config.iLanguage               = PSP_SYSTEMPARAM_LANGUAGE_ENGLISH;
+    g_Config.iFirmwareVersion        = PSP_DEFAULT_FIRMWARE;
+    g_Config.iPSPModel               = PSP_MODEL_SLIM;
+    g_Config.bMemStickInserted       = true;
+    g_Config.bEnableSound            = true;
+
+    // Nothing that depends on the machine or the network, so runs compare across hosts.
+    g_Config.bEnableNetworking       = false;
+    g_Config.bEnableCheats           = false;
+    g_Config.iLockedCPUSpeed         = 0;
+
+    // Unthrottled: fast forward without frame skipping, so every frame is emulated.
+    g_Config.iFastForwardMode        = (int)FastForwardMode::CONTINUOUS;
+    g_Config.iFrameSkip              = 0;
+
+    NativeInit(0, nullptr, nullptr, options.assetsDirectory.c_str(), nullptr);
+
+    if (options.glBackend) {
+        if (!CreateOffscreenGLContext(480, 272)) {
+            *errorString = "No EGL context, try EGL_PLATFORM=surfaceless";
+            return false;
+        }
+        glContext = OpenEmuGLContext::CreateGraphicsContext();
+        NativeInitGraphics(glContext);
+        // Frames run on this thread, so it's also the one running ThreadFrame.
+        glContext->ThreadStart();
+    } else {
+        graphicsContext = new NullGraphicsContext();
+        NativeInitGraphics(graphicsContext);
+    }
+
+    coreParam.cpuCore         = options.cpuCore;
+    coreParam.gpuCore         = glContext ? GPUCORE_GLES : GPUCORE_SOFTWARE;
+    coreParam.graphicsContext = glContext ? (GraphicsContext *)glContext : graphicsContext;
+    coreParam.enableSound     = true;
+    coreParam.fileToStart     = options.fileToStart;
+    OpenEmuFileLoader::RegisterForImage(coreParam.fileToStart);
+    coreParam.mountIso        = Path();
+    coreParam.startBreak      = false;
+    coreParam.printfEmuLog    = false;
+    coreParam.headLess        = true;
+    coreParam.renderWidth     = 480;
+    coreParam.renderHeight    = 272;
+    coreParam.pixelWidth      = 480;
+    coreParam.pixelHeight     = 272;
+
+    coreState = CORE_POWERUP;
+    {
+        OpenEmuStartupTrace::ScopedStep step("PSP_Init");
+        if (!PSP_Init(coreParam, errorString))
+            return false;
+    }
+
+    PSP_CoreParameter().fastForward = true;
+    OpenEmuJitCache::OnGameStarted();
+    OpenEmuShaderCache::OnGameStarted();
+    host->BootDone();
+    // Only now, so the threads PSP_Init started didn't inherit the emu thread's pinning.
+    OpenEmuThreadPlacement::PlaceCurrentThread(OpenEmuThreadPlacement::Role::EMU);
+    OpenEmuThreadPlacement::PlaceWorkers();
+    return true;
+}
+
+bool HeadlessRunFrame() {
+    if (coreState == CORE_POWERDOWN || coreState == CORE_BOOT_ERROR || coreState == CORE_RUNTIME_ERROR)
+        return false;
+
+    NativeFrame();
+    if (glContext) {
+        NativeRender(glContext);
+        // So the frame time includes the GL work, not just queueing it.
+        glFinish();
+    }
+    OpenEmuStartupTrace::FirstFrame();
+
+    // The per frame counters hold the frame that just ran until the next one starts.
+    gpuTotals.frames++;
+    gpuTotals.drawCalls += gpuStats.numDrawCalls;
+    gpuTotals.flushes += gpuStats.numFlushes;
+    gpuTotals.vertices += gpuStats.numVertsSubmitted;
+    gpuTotals.texturesDecoded += gpuStats.numTexturesDecoded;
+    return true;
+}
+
+void HeadlessShutdown() {
+    OpenEmuJitCache::OnGameStopped();
+    OpenEmuShaderCache::OnGameStopped();
+    PSP_Shutdown();
+    if (glContext)
+        glContext->ThreadEnd();
+
+    NativeShutdownGraphics();
+    NativeShutdown();
+
+    delete graphicsContext;
+    graphicsContext = nullptr;
+}
+
+HeadlessGpuStats HeadlessGetGpuStats() {
+    return gpuTotals;
+}
+
+void HeadlessResetGpuStats() {
+    gpuTotals = HeadlessGpuStats();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+
+#include "Common/File/Path.h"
+#include "Core/CoreParameter.h"
+
+#include "OpenEmuThreadPlacement.h"
+
+struct HeadlessOptions {
+    Path fileToStart;
+    // Where ppge_atlas.zim and friends live, same as the bundle resources in the plugin.
+    std::string assetsDirectory = "assets/";
+    std::string memStickDirectory = "headless/";
+    CPUCore cpuCore = CPUCore::JIT;
+    // Chrome trace of the startup steps, written after the first frame. Empty for none.
+    Path startupTrace;
+    // Frames run on the calling thread, which is placed as the emu thread.
+    OpenEmuThreadPlacement::Policy threadPolicy = OpenEmuThreadPlacement::Policy::OS;
+    // Precompile from and record to the JIT block cache under memstick/cache/.
+    bool jitCache = false;
+    // Render through OpenEmuGLContext on an offscreen EGL context instead of the software
+    // renderer, with ThreadFrame and a glFinish after every frame. Linux only.
+    bool glBackend = false;
+};
+
+// gpuStats summed over the frames run since the last reset.
+struct HeadlessGpuStats {
+    uint64_t frames;
+    uint64_t drawCalls;
+    // Each one is a batch the GPU backend had to submit, mostly because state changed.
+    uint64_t flushes;
+    uint64_t vertices;
+    uint64_t texturesDecoded;
+};
+
+// Brings the core up the same way PPSSPPGameCore does, but with a
+// NullGraphicsContext and without starting the emu thread. Frames are run
+// unthrottled on the calling thread with HeadlessRunFrame.
+bool HeadlessBoot(const HeadlessOptions &options, std::string *errorString);
+
+// Runs one emulated frame. Returns false once the core stopped or crashed.
+bool HeadlessRunFrame();
+
+void HeadlessShutdown();
+
+HeadlessGpuStats HeadlessGetGpuStats();
+void HeadlessResetGpuStats();
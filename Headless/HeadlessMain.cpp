@@ -0,0 +1,452 @@
+// Headless frame benchmark for the OpenEmu core glue.
+//
+// Boots an image through NativeInit / NativeInitGraphics with a null graphics
+// context and runs a fixed number of frames unthrottled, timing every call to
+// the same EmuFrame the plugin's emu thread uses.
+//
+//   PPSSPPHeadless [options] <image>
+//     --frames N       frames to measure (default 1800)
+//     --warmup N       frames to run before measuring (default 120)
+//     --assets DIR     directory with ppge_atlas.zim etc. (default assets/)
+//     --memstick DIR   memory stick / flash0 directory (default headless/)
+//     --interpreter    use the interpreter instead of the JIT
+//     --per-frame      print the emu time of every measured frame
+//     --speed N        fast-forward at 2, 4 or 8x, 0 for unbounded; fps is then the
+//                      host frame rate and "emulated" the actual game frame rate
+//     --perf-csv FILE  enable the per-frame perf counters while measuring and dump
+//                      them to FILE; compare fps with and without for their overhead
+//     --json           print the results as a single JSON object
+//     --startup-trace FILE
+//                      write a Chrome trace of the boot steps up to the first frame
+//     --thread-policy os|priority|performance
+//                      thread placement, see OpenEmuThreadPlacement.h
+//     --jit-cache      precompile the blocks earlier runs compiled and record new ones,
+//                      see OpenEmuJitCache.h; run twice to compare cold and warm
+//     --gl             render through OpenEmuGLContext on an offscreen EGL context
+//                      instead of the software renderer (Linux, EGL_PLATFORM=surfaceless
+//                      for llvmpipe), frame times then include the GL work; also
+//                      reports shader cache hits and misses, see OpenEmuShaderCache.h.
+//                      Not run yet, only in builds configured with -DPPSSPP_HEADLESS_GL=ON
+//     --record-ge N    record N GE frame dumps while measuring, into the memstick's
+//                      PSP/SYSTEM/DUMP, see OpenEmuGeDump.h
+//     --record-movie FILE
+//                      record the measured frames' input as a movie, see
+//                      OpenEmuInputMovie.h; neither movie option works with --speed
+//     --replay-movie FILE
+//                      replay a movie over the measured frames instead, the exit code
+//                      is 1 if it desynced; same movie on two builds, same workload
+//     --memory-budget MB
+//                      account memory per subsystem and evict caches over MB resident,
+//                      0 only accounts; the exit code is 1 if the peak over the measured
+//                      frames went over, see OpenEmuMemory.h
+//     --run-ahead N    run N frames ahead every host frame and report what it adds on top
+//                      of the real frame, see OpenEmuRunAhead.h
+//     --rewind K[:MB]  capture a rewind snapshot every K emulated frames while measuring,
+//                      in MB (default 64); afterwards steps back half the emulated frames
+//                      and reports snapshot cost and size, see OpenEmuRewind.h
+//
+//   PPSSPPHeadless --gl [options] <dump.ppdmp>
+//     replays a GE dump through the GL backend in a loop, without the game or the CPU
+//     core; reports frame times plus draw calls and flushes per frame. Same build
+//     option as --gl
+//
+//   PPSSPPHeadless --batch [options] <image>...
+//     runs every image in its own process, in parallel, see BatchRunner.h
+//
+//   PPSSPPHeadless --bench-resampler
+//     audio resampler throughput per quality level, no image needed
+//
+//   PPSSPPHeadless --bench-logging
+//     per message cost on the logging thread, synchronous vs asynchronous logger
+//
+//   PPSSPPHeadless --bench-cso <image.cso>
+//     CSO read throughput and stall time, synchronous vs prefetching decompression
+//
+//   PPSSPPHeadless --bench-threads
+//     frame time variance of a synthetic emu/render pipeline under each thread policy
+//
+//   PPSSPPHeadless --bench-frame-export
+//     PBO readback into the shared memory ring on an offscreen EGL context (Linux,
+//     EGL_PLATFORM=surfaceless for llvmpipe without a GPU)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "Common/Data/Format/JSONWriter.h"
+#include "Common/TimeUtil.h"
+#include "Core/System.h"
+
+#include "BatchRunner.h"
+#include "FrameStats.h"
+#include "HeadlessHost.h"
+#include "MicroBenchmarks.h"
+#include "OpenEmuCsoLoader.h"
+#include "OpenEmuFastForward.h"
+#include "OpenEmuFileLoader.h"
+#include "OpenEmuGeDump.h"
+#include "OpenEmuInputMovie.h"
+#include "OpenEmuJitCache.h"
+#include "OpenEmuShaderCache.h"
+#include "OpenEmuMemory.h"
+#include "OpenEmuPerfCounters.h"
+#include "OpenEmuRewind.h"
+#include "OpenEmuRunAhead.h"
+#include "OpenEmuStartupTrace.h"
+#include "OpenEmuThreadPlacement.h"
+
+struct BenchmarkOptions {
+    int frames = 1800;
+    int warmup = 120;
+    bool perFrame = false;
+    int speed = OpenEmuFastForward::NORMAL;
+    std::string perfCsv;
+    bool json = false;
+    int recordGe = 0;
+    std::string recordMovie;
+    std::string replayMovie;
+    // -1 when off.
+    int memoryBudgetMb = -1;
+    // 0 when off.
+    int runAhead = 0;
+    // 0 when off.
+    int rewindInterval = 0;
+    int rewindBudgetMb = 64;
+};
+
+static void PrintUsage(const char *name) {
+    fprintf(stderr, "Usage: %s [--frames N] [--warmup N] [--assets DIR] [--memstick DIR] [--interpreter] [--per-frame] [--speed N] [--perf-csv FILE] [--json] [--startup-trace FILE] [--thread-policy POLICY] [--jit-cache] [--gl] [--record-ge N] [--record-movie FILE | --replay-movie FILE] [--memory-budget MB] [--run-ahead N] [--rewind K[:MB]] <image>\n", name);
+    fprintf(stderr, "       %s --batch [--jobs N] [--list FILE] [--report FILE] [--baseline FILE] [--threshold PCT] [options] <image>...\n", name);
+    fprintf(stderr, "       %s --bench-resampler\n", name);
+    fprintf(stderr, "       %s --bench-logging\n", name);
+    fprintf(stderr, "       %s --bench-cso <image.cso>\n", name);
+    fprintf(stderr, "       %s --bench-threads\n", name);
+    fprintf(stderr, "       %s --bench-frame-export\n", name);
+}
+
+static bool ParseArgs(int argc, const char *argv[], HeadlessOptions *options, BenchmarkOptions *bench) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "--frames") && hasValue) {
+            bench->frames = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--warmup") && hasValue) {
+            bench->warmup = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--assets") && hasValue) {
+            options->assetsDirectory = argv[++i];
+        } else if (!strcmp(arg, "--memstick") && hasValue) {
+            options->memStickDirectory = argv[++i];
+        } else if (!strcmp(arg, "--interpreter")) {
+            options->cpuCore = CPUCore::INTERPRETER;
+        } else if (!strcmp(arg, "--per-frame")) {
+            bench->perFrame = true;
+        } else if (!strcmp(arg, "--speed") && hasValue) {
+            bench->speed = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--perf-csv") && hasValue) {
+            bench->perfCsv = argv[++i];
+        } else if (!strcmp(arg, "--json")) {
+            bench->json = true;
+        } else if (!strcmp(arg, "--startup-trace") && hasValue) {
+            options->startupTrace = Path(argv[++i]);
+        } else if (!strcmp(arg, "--thread-policy") && hasValue) {
+            if (!OpenEmuThreadPlacement::ParsePolicy(argv[++i], &options->threadPolicy)) {
+                fprintf(stderr, "Unknown thread policy %s\n", argv[i]);
+                return false;
+            }
+        } else if (!strcmp(arg, "--jit-cache")) {
+            options->jitCache = true;
+        } else if (!strcmp(arg, "--gl")) {
+#ifdef HEADLESS_GL
+            options->glBackend = true;
+#else
+            fprintf(stderr, "--gl isn't in this build, configure with -DPPSSPP_HEADLESS_GL=ON\n");
+            return false;
+#endif
+        } else if (!strcmp(arg, "--record-ge") && hasValue) {
+            bench->recordGe = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--record-movie") && hasValue) {
+            bench->recordMovie = argv[++i];
+        } else if (!strcmp(arg, "--replay-movie") && hasValue) {
+            bench->replayMovie = argv[++i];
+        } else if (!strcmp(arg, "--memory-budget") && hasValue) {
+            bench->memoryBudgetMb = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--run-ahead") && hasValue) {
+            bench->runAhead = atoi(argv[++i]);
+            if (bench->runAhead < 0 || bench->runAhead > OpenEmuRunAhead::MAX_FRAMES) {
+                fprintf(stderr, "Run-ahead is 0 to %d frames\n", OpenEmuRunAhead::MAX_FRAMES);
+                return false;
+            }
+        } else if (!strcmp(arg, "--rewind") && hasValue) {
+            if (sscanf(argv[++i], "%d:%d", &bench->rewindInterval, &bench->rewindBudgetMb) < 1 || bench->rewindInterval <= 0 || bench->rewindBudgetMb <= 0) {
+                fprintf(stderr, "Bad rewind interval %s\n", argv[i]);
+                return false;
+            }
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return false;
+        } else {
+            options->fileToStart = Path(arg);
+        }
+    }
+    // A movie holds one input per emulated frame, see OpenEmuInputMovie.h.
+    if (bench->speed != OpenEmuFastForward::NORMAL && (!bench->recordMovie.empty() || !bench->replayMovie.empty())) {
+        fprintf(stderr, "--speed can't be combined with --record-movie or --replay-movie\n");
+        return false;
+    }
+    return !options->fileToStart.empty() && bench->frames > 0 && bench->warmup >= 0;
+}
+
+static void PrintJson(const Path &image, int frames, double elapsed, uint64_t emulated, const FrameTimeHistogram &histogram, const HeadlessGpuStats &gpu) {
+    json::JsonWriter writer;
+    writer.begin();
+    writer.writeString("image", image.ToString().c_str());
+    writer.writeInt("frames", frames);
+    writer.writeFloat("elapsedSeconds", elapsed);
+    writer.writeFloat("fps", frames / elapsed);
+    writer.writeFloat("emulatedFps", emulated / elapsed);
+    writer.writeFloat("meanMs", histogram.Mean());
+    writer.writeFloat("stddevMs", histogram.StdDev());
+    writer.writeFloat("minMs", histogram.Min());
+    writer.writeFloat("maxMs", histogram.Max());
+    writer.writeFloat("p50Ms", histogram.Percentile(50));
+    writer.writeFloat("p90Ms", histogram.Percentile(90));
+    writer.writeFloat("p99Ms", histogram.Percentile(99));
+    writer.writeFloat("p999Ms", histogram.Percentile(99.9));
+    writer.writeFloat("startupMs", OpenEmuStartupTrace::TimeToFirstFrameMs());
+    if (gpu.frames > 0) {
+        writer.writeFloat("drawCallsPerFrame", (double)gpu.drawCalls / gpu.frames);
+        writer.writeFloat("flushesPerFrame", (double)gpu.flushes / gpu.frames);
+    }
+    if (OpenEmuMemory::IsEnabled())
+        writer.writeFloat("peakRssMb", OpenEmuMemory::PeakRss() / 1048576.0);
+    writer.end();
+    printf("%s\n", writer.str().c_str());
+}
+
+static int RunFrameBenchmark(const HeadlessOptions &options, const BenchmarkOptions &bench) {
+    OpenEmuFastForward::SetSpeed(bench.speed);
+    OpenEmuRunAhead::SetFrames(bench.runAhead);
+    // From the start, so the caches are already held under it while warming up.
+    if (bench.memoryBudgetMb >= 0) {
+        OpenEmuMemory::SetEnabled(true);
+        OpenEmuMemory::SetBudget((uint64_t)bench.memoryBudgetMb * 1024 * 1024);
+    }
+
+    for (int i = 0; i < bench.warmup; i++) {
+        if (!HeadlessRunFrame()) {
+            fprintf(stderr, "Core stopped during warmup at frame %d\n", i);
+            return 1;
+        }
+    }
+
+    bool perf = !bench.perfCsv.empty();
+    if (perf) {
+        if (!OpenEmuPerfCounters::StartDump(Path(bench.perfCsv), OpenEmuPerfCounters::DumpFormat::CSV))
+            return 1;
+        OpenEmuPerfCounters::SetEnabled(true);
+    }
+    if (bench.recordGe > 0)
+        OpenEmuGeDump::Start(GetSysDirectory(DIRECTORY_DUMP), bench.recordGe);
+    if (!bench.recordMovie.empty())
+        OpenEmuInputMovie::StartRecording(Path(bench.recordMovie));
+    if (!bench.replayMovie.empty()) {
+        std::string error;
+        if (!OpenEmuInputMovie::StartReplay(Path(bench.replayMovie), &error)) {
+            fprintf(stderr, "Can't replay %s: %s\n", bench.replayMovie.c_str(), error.c_str());
+            return 1;
+        }
+    }
+
+    // Measured frames include the captures.
+    if (bench.rewindInterval > 0)
+        OpenEmuRewind::Configure(bench.rewindInterval, (size_t)bench.rewindBudgetMb * 1024 * 1024);
+
+    HeadlessResetGpuStats();
+    OpenEmuMemory::ResetPeakRss();
+    FrameTimeHistogram histogram;
+    uint64_t emulatedBefore = OpenEmuFastForward::GetStats().emulatedFrames;
+    double start = time_now_d();
+    int frames = 0;
+    for (; frames < bench.frames; frames++) {
+        double frameStart = time_now_d();
+        if (!HeadlessRunFrame()) {
+            fprintf(stderr, "Core stopped after %d measured frames\n", frames);
+            break;
+        }
+        double ms = (time_now_d() - frameStart) * 1000.0;
+        histogram.Add(ms);
+        if (bench.perFrame)
+            printf("frame %d: %.3f ms\n", frames, ms);
+    }
+    double elapsed = time_now_d() - start;
+    uint64_t emulated = OpenEmuFastForward::GetStats().emulatedFrames - emulatedBefore;
+    HeadlessGpuStats gpu = HeadlessGetGpuStats();
+    OpenEmuInputMovie::Stats movie = OpenEmuInputMovie::GetStats();
+    OpenEmuInputMovie::Stop();
+    bool desynced = movie.desyncs > 0;
+    if (desynced)
+        fprintf(stderr, "Movie desynced at frame %lld\n", (long long)movie.firstDesyncFrame);
+    OpenEmuMemory::Stats memory = OpenEmuMemory::GetStats();
+    bool overBudget = memory.budgetBytes != 0 && memory.peakRssBytes > memory.budgetBytes;
+    if (overBudget)
+        fprintf(stderr, "Peak resident %.1f MB, over the %d MB budget\n", memory.peakRssBytes / 1048576.0, bench.memoryBudgetMb);
+
+    if (perf) {
+        OpenEmuPerfCounters::SetEnabled(false);
+        OpenEmuPerfCounters::StopDump();
+    }
+
+    if (frames == 0)
+        return 1;
+
+    // Outside the measurement, one more frame applies the step back at its boundary.
+    // Not while a movie replays, it would only desync.
+    bool steppedBack = false;
+    int stepBackFrames = (int)(emulated / 2);
+    if (bench.rewindInterval > 0 && bench.replayMovie.empty() && OpenEmuRewind::RequestStepBack(stepBackFrames))
+        steppedBack = HeadlessRunFrame();
+    OpenEmuRewind::Stats rewind = OpenEmuRewind::GetStats();
+
+    if (bench.json) {
+        PrintJson(options.fileToStart, frames, elapsed, emulated, histogram, gpu);
+        return frames == bench.frames && !desynced && !overBudget ? 0 : 1;
+    }
+
+    printf("startup: %.1f ms to first frame\n", OpenEmuStartupTrace::TimeToFirstFrameMs());
+    if (OpenEmuThreadPlacement::GetPolicy() != OpenEmuThreadPlacement::Policy::OS)
+        printf("threads: %s\n", OpenEmuThreadPlacement::DescribePlan().c_str());
+    printf("frames:  %d in %.3f s\n", frames, elapsed);
+    printf("fps:     %.2f (%.2fx realtime)\n", frames / elapsed, frames / elapsed / 59.94);
+    if (OpenEmuFastForward::GetSpeed() != OpenEmuFastForward::NORMAL)
+        printf("emulated: %llu frames, %.2f fps (%.2fx realtime)\n", (unsigned long long)emulated, emulated / elapsed, emulated / elapsed / 59.94);
+    printf("emu ms:  mean %.3f  stddev %.3f  min %.3f  max %.3f\n", histogram.Mean(), histogram.StdDev(), histogram.Min(), histogram.Max());
+    printf("         p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f\n", histogram.Percentile(50), histogram.Percentile(90), histogram.Percentile(99), histogram.Percentile(99.9));
+
+    OpenEmuFileLoader::Stats io = OpenEmuFileLoader::GetStats();
+    if (io.reads > 0) {
+        printf("iso:     %llu reads, %.1f MB, %llu stalls (%.1f ms), %.1f MB read ahead, %llu hits\n", (unsigned long long)io.reads,
+            io.bytesRead / 1048576.0, (unsigned long long)io.stalls, io.stallMs, io.prefetchedBytes / 1048576.0, (unsigned long long)io.prefetchHits);
+    }
+    OpenEmuCsoLoader::Stats cso = OpenEmuCsoLoader::GetStats();
+    if (cso.reads > 0) {
+        printf("cso:     %llu reads, %.1f MB, stalled %.1f ms (%llu waits, %llu sync decodes), %llu chunks prefetched\n", (unsigned long long)cso.reads,
+            cso.bytesRead / 1048576.0, cso.stallMs, (unsigned long long)cso.prefetchWaits, (unsigned long long)cso.syncDecodes, (unsigned long long)cso.prefetchedChunks);
+    }
+
+    if (options.glBackend && gpu.frames > 0) {
+        printf("gpu:     %.1f draw calls, %.1f flushes, %.0f vertices, %.2f texture decodes per frame\n", (double)gpu.drawCalls / gpu.frames,
+            (double)gpu.flushes / gpu.frames, (double)gpu.vertices / gpu.frames, (double)gpu.texturesDecoded / gpu.frames);
+    }
+    if (bench.recordGe > 0) {
+        OpenEmuGeDump::Stats dumps = OpenEmuGeDump::GetStats();
+        printf("ge dump: %llu of %d frames, %.1f MB\n", (unsigned long long)dumps.recorded, bench.recordGe, dumps.bytes / 1048576.0);
+        for (const std::string &file : dumps.files)
+            printf("         %s\n", file.c_str());
+    }
+    if (!bench.recordMovie.empty())
+        printf("movie:   %llu frames recorded to %s\n", (unsigned long long)movie.frames, bench.recordMovie.c_str());
+    if (!bench.replayMovie.empty()) {
+        printf("movie:   %llu of %llu frames replayed, %llu hash checks, %llu desynced\n", (unsigned long long)movie.frames,
+            (unsigned long long)movie.movieFrames, (unsigned long long)movie.hashChecks, (unsigned long long)movie.desyncs);
+    }
+    if (OpenEmuMemory::IsEnabled()) {
+        printf("memory:  %.1f MB resident, %.1f MB peak", memory.rssBytes / 1048576.0, memory.peakRssBytes / 1048576.0);
+        if (memory.budgetBytes != 0)
+            printf(" of %.1f MB budget, over it at %llu checks", memory.budgetBytes / 1048576.0, (unsigned long long)memory.overBudgetChecks);
+        printf("\n");
+        for (int i = 0; i < (int)OpenEmuMemory::Subsystem::COUNT; i++) {
+            const OpenEmuMemory::Usage &usage = memory.usage[i];
+            printf("         %-14s", OpenEmuMemory::SubsystemName((OpenEmuMemory::Subsystem)i));
+            if (usage.measured)
+                printf(" %8.1f MB", usage.bytes / 1048576.0);
+            else
+                printf("           -");
+            if (usage.items != 0)
+                printf(", %llu items", (unsigned long long)usage.items);
+            if (usage.evictions != 0)
+                printf(", evicted %llu times", (unsigned long long)usage.evictions);
+            printf("\n");
+        }
+        printf("         %-14s %8.1f MB\n", "other", memory.otherBytes / 1048576.0);
+    }
+    if (bench.runAhead > 0) {
+        OpenEmuRunAhead::Stats runAhead = OpenEmuRunAhead::GetStats();
+        printf("runahead: %d frames, real frame %.3f ms, +%.3f ms per host frame (snapshot %.3f, %.3f per speculative frame, rollback %.3f)\n",
+            runAhead.frames, runAhead.realFrameMs, runAhead.extraMs, runAhead.snapshotMs, runAhead.speculativeFrameMs, runAhead.rollbackMs);
+        if (runAhead.failedSnapshots > 0)
+            printf("         %llu failed snapshots\n", (unsigned long long)runAhead.failedSnapshots);
+    }
+    if (bench.rewindInterval > 0) {
+        printf("rewind:  %u snapshots every %u frames, %.1f MB of %.1f MB, %.1f KB per delta, %.1f KB full state\n", rewind.snapshots,
+            rewind.intervalFrames, rewind.memoryBytes / 1048576.0, rewind.budgetBytes / 1048576.0, rewind.averageSnapshotBytes / 1024.0, rewind.fullStateBytes / 1024.0);
+        printf("         capture %.3f ms last, %.3f ms/frame spread", rewind.lastCaptureMs, rewind.captureCostPerFrameMs);
+        if (steppedBack && rewind.stepBacks > 0)
+            printf(", stepped back %u of %d frames in %.3f ms", rewind.lastStepBackFrames, stepBackFrames, rewind.lastStepBackMs);
+        printf("\n");
+    }
+    if (OpenEmuJitCache::IsEnabled()) {
+        OpenEmuJitCache::Stats jit = OpenEmuJitCache::GetStats();
+        printf("jit:     %llu cached blocks, %llu precompiled in %.1f ms, %llu already compiled, %llu deferred\n", (unsigned long long)jit.loaded,
+            (unsigned long long)jit.precompiled, jit.precompileMs, (unsigned long long)jit.alreadyCompiled, (unsigned long long)jit.deferred);
+        printf("         %llu compiled by the game in %llu frames (%.3f ms mean), %llu over a frame\n", (unsigned long long)jit.runtimeCompiles,
+            (unsigned long long)jit.compileFrames, jit.compileFrames ? jit.compileFrameMs / jit.compileFrames : 0.0, (unsigned long long)jit.stutterFrames);
+    }
+    if (OpenEmuShaderCache::IsEnabled()) {
+        OpenEmuShaderCache::Stats shaders = OpenEmuShaderCache::GetStats();
+        printf("shaders: %llu precompiled, %llu hits, %llu misses\n", (unsigned long long)shaders.precompiled,
+            (unsigned long long)shaders.hits, (unsigned long long)shaders.misses);
+        printf("         compiled in %llu frames, %.1f ms (%.3f ms max)\n", (unsigned long long)shaders.compileFrames,
+            shaders.compileMs, shaders.maxCompileFrameMs);
+    }
+
+    if (perf) {
+        OpenEmuPerfCounters::Totals totals = OpenEmuPerfCounters::GetTotals();
+        for (int i = 0; i < OpenEmuPerfCounters::NUM_COUNTERS && totals.frames > 0; i++) {
+            if (totals.calls[i] == 0)
+                continue;
+            printf("%-17s %.3f ms/frame  (%llu calls)\n", OpenEmuPerfCounters::CounterName((OpenEmuPerfCounters::Counter)i),
+                totals.ms[i] / totals.frames, (unsigned long long)totals.calls[i]);
+        }
+        for (int i = 0; i < OpenEmuPerfCounters::NUM_EVENTS && totals.frames > 0; i++) {
+            if (totals.events[i] == 0)
+                continue;
+            printf("%-17s %llu\n", OpenEmuPerfCounters::EventName((OpenEmuPerfCounters::Event)i), (unsigned long long)totals.events[i]);
+        }
+    }
+    return frames == bench.frames && !desynced && !overBudget ? 0 : 1;
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc == 2 && !strcmp(argv[1], "--bench-resampler"))
+        return BenchmarkResampler();
+    if (argc == 2 && !strcmp(argv[1], "--bench-logging"))
+        return BenchmarkLogging();
+    if (argc == 3 && !strcmp(argv[1], "--bench-cso"))
+        return BenchmarkCsoReads(argv[2]);
+    if (argc == 2 && !strcmp(argv[1], "--bench-threads"))
+        return BenchmarkThreadPlacement();
+    if (argc == 2 && !strcmp(argv[1], "--bench-frame-export"))
+        return BenchmarkFrameExport();
+    if (argc >= 2 && !strcmp(argv[1], "--batch"))
+        return RunBatch(argc, argv);
+
+    HeadlessOptions options;
+    BenchmarkOptions bench;
+    if (!ParseArgs(argc, argv, &options, &bench)) {
+        PrintUsage(argv[0]);
+        return 2;
+    }
+
+    std::string error;
+    if (!HeadlessBoot(options, &error)) {
+        fprintf(stderr, "Failed to boot %s: %s\n", options.fileToStart.c_str(), error.c_str());
+        HeadlessShutdown();
+        return 1;
+    }
+
+    int result = RunFrameBenchmark(options, bench);
+
+    HeadlessShutdown();
+    return result;
+}
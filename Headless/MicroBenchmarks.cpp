@@ -0,0 +1,464 @@
+#include "MicroBenchmarks.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Common/CPUDetect.h"
+#include "Common/Thread/ThreadManager.h"
+#include "Common/Thread/ThreadUtil.h"
+#include "Common/TimeUtil.h"
+#include "Core/FileLoaders/LocalFileLoader.h"
+
+#include "FrameStats.h"
+#include "OffscreenGL.h"
+
+#include "OpenEmuCsoLoader.h"
+#include "OpenEmuFrameExport.h"
+#include "OpenEmuLog.h"
+#include "OpenEmuResampler.h"
+#include "OpenEmuThreadPlacement.h"
+
+int BenchmarkResampler() {
+    // One emulated frame of 44.1 kHz audio at a time, like OpenEmuAudio::Produce.
+    const int inputRate = 44100;
+    const int chunkFrames = 736;
+    const int chunks = 20000;
+
+    std::vector<int16_t> input(chunkFrames * 2);
+    for (int i = 0; i < chunkFrames; i++) {
+        input[i * 2] = (int16_t)(8000.0 * sin(i * 0.05));
+        input[i * 2 + 1] = (int16_t)(8000.0 * cos(i * 0.07));
+    }
+
+    const int outputRates[] = { 44100, 48000, 96000 };
+    const struct {
+        AudioResampler::Quality quality;
+        const char *name;
+    } qualities[] = {
+        { AudioResampler::Quality::LINEAR, "linear" },
+        { AudioResampler::Quality::SINC, "sinc" },
+    };
+
+    for (int outputRate : outputRates) {
+        for (const auto &q : qualities) {
+            AudioResampler resampler(inputRate, outputRate, q.quality);
+            std::vector<int16_t> output(resampler.OutputFramesFor(chunkFrames) * 2);
+
+            size_t produced = 0;
+            double start = time_now_d();
+            for (int i = 0; i < chunks; i++) {
+                // Wobble the ratio like the buffer depth control does.
+                resampler.SetRateCorrection(1.0 + 0.002 * sin(i * 0.01));
+                produced += resampler.Process(&input[0], chunkFrames, &output[0], output.size() / 2);
+            }
+            double elapsed = time_now_d() - start;
+
+            printf("resampler %-6s 44100 -> %5d Hz: %8.2f M input frames/s, %8.2f M output frames/s (%.0fx realtime)\n",
+                q.name, outputRate,
+                (double)chunks * chunkFrames / elapsed / 1e6, produced / elapsed / 1e6,
+                (double)chunks * chunkFrames / inputRate / elapsed);
+        }
+    }
+    return 0;
+}
+
+// What NativeInit used before: format and write on the logging thread.
+class SyncLogListener : public LogListener {
+public:
+    explicit SyncLogListener(FILE *out) : out_(out) {}
+    void Log(const LogMessage &msg) override {
+        fprintf(out_, "%s %s %s", msg.timestamp, msg.header, msg.msg.c_str());
+        fflush(out_);
+    }
+
+private:
+    FILE *out_;
+};
+
+static double TimeLogBursts(LogListener *listener, int bursts, int burstSize) {
+    LogMessage msg;
+    snprintf(msg.timestamp, sizeof(msg.timestamp), "%s", "12:34:56:789");
+    snprintf(msg.header, sizeof(msg.header), "%s", "Core/HLE/sceKernelThread.cpp:1234 I[SCEKERNEL]:");
+    msg.level = LogTypes::LINFO;
+    msg.log = "SCEKERNEL";
+    msg.msg = "sceKernelDelayThread(1000): delaying thread 0x12a for 1000 us\n";
+
+    double total = 0.0;
+    for (int i = 0; i < bursts; i++) {
+        double start = time_now_d();
+        for (int j = 0; j < burstSize; j++)
+            listener->Log(msg);
+        total += time_now_d() - start;
+        // A chatty game logs in bursts, once or twice per frame.
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return total * 1e9 / ((double)bursts * burstSize);
+}
+
+int BenchmarkLogging() {
+    const int bursts = 2000;
+    const int burstSizes[] = { 16, 64, 512 };
+
+    // A real file rather than /dev/null, so the synchronous path pays for actual I/O.
+    FILE *out = tmpfile();
+    if (!out) {
+        fprintf(stderr, "Can't create a temporary file\n");
+        return 1;
+    }
+
+    for (int burstSize : burstSizes) {
+        SyncLogListener sync(out);
+        double syncNs = TimeLogBursts(&sync, bursts, burstSize);
+
+        AsyncLogListener async(out);
+        double asyncNs = TimeLogBursts(&async, bursts, burstSize);
+        async.Flush();
+        AsyncLogListener::Stats stats = async.GetStats();
+
+        printf("log burst %3d: sync %8.1f ns/msg, async %6.1f ns/msg (%llu written, %llu dropped)\n",
+            burstSize, syncNs, asyncNs, (unsigned long long)stats.written, (unsigned long long)stats.dropped);
+    }
+
+    fclose(out);
+    return 0;
+}
+
+enum class CsoPattern {
+    SEQUENTIAL,
+    STREAMING,
+    RANDOM,
+};
+
+static void TimeCsoReads(const char *image, bool prefetch, CsoPattern pattern) {
+    const size_t sector = 2048;
+    // Sequential: 32 KB reads back to back over the first 256 MB, raw throughput.
+    // Streaming: the same reads over 32 MB with the reader busy elsewhere in between, like
+    // an FMV read a bit at a time per frame. Random: single sectors all over the image,
+    // like a game loading scattered files.
+    const size_t sequentialRead = 16 * sector;
+    const s64 sequentialLimit = 256 * 1024 * 1024;
+    const s64 streamingLimit = 32 * 1024 * 1024;
+    const int randomReads = 20000;
+
+    CsoFileLoader loader(new LocalFileLoader(Path(image)), prefetch);
+    std::vector<uint8_t> buffer(sequentialRead);
+    OpenEmuCsoLoader::ResetStats();
+
+    double start = time_now_d();
+    if (pattern == CsoPattern::RANDOM) {
+        std::mt19937 rng(1234);
+        std::uniform_int_distribution<s64> pick(0, loader.FileSize() / sector - 1);
+        for (int i = 0; i < randomReads; i++)
+            loader.ReadAt(pick(rng) * sector, sector, &buffer[0]);
+    } else {
+        bool streaming = pattern == CsoPattern::STREAMING;
+        s64 end = std::min(loader.FileSize(), streaming ? streamingLimit : sequentialLimit);
+        for (s64 pos = 0; pos < end; pos += sequentialRead) {
+            loader.ReadAt(pos, sequentialRead, &buffer[0]);
+            if (streaming)
+                std::this_thread::sleep_for(std::chrono::microseconds(250));
+        }
+    }
+    double elapsed = time_now_d() - start;
+
+    static const char *const names[] = { "sequential", "streaming", "random" };
+    OpenEmuCsoLoader::Stats stats = OpenEmuCsoLoader::GetStats();
+    printf("cso %-10s %-8s %8.1f MB/s, stalled %8.1f ms (%llu hits, %llu waits, %llu sync decodes, %llu prefetched)\n",
+        names[(int)pattern], prefetch ? "prefetch" : "sync", stats.bytesRead / elapsed / 1048576.0, stats.stallMs,
+        (unsigned long long)stats.hits, (unsigned long long)stats.prefetchWaits, (unsigned long long)stats.syncDecodes,
+        (unsigned long long)stats.prefetchedChunks);
+}
+
+int BenchmarkCsoReads(const char *image) {
+    {
+        CsoFileLoader probe(new LocalFileLoader(Path(image)));
+        if (!probe.IsValid()) {
+            fprintf(stderr, "%s isn't a CSO this loader can read\n", image);
+            return 1;
+        }
+    }
+
+    // The same pool NativeInit sets up for the core.
+    g_threadManager.Init(cpu_info.num_cores, cpu_info.logical_cpu_count);
+
+    // Once through first so every run sees the file in the page cache, this is about
+    // decompression, not the disk.
+    TimeCsoReads(image, false, CsoPattern::SEQUENTIAL);
+
+    for (CsoPattern pattern : { CsoPattern::SEQUENTIAL, CsoPattern::STREAMING, CsoPattern::RANDOM }) {
+        TimeCsoReads(image, false, pattern);
+        TimeCsoReads(image, true, pattern);
+    }
+
+    g_threadManager.Teardown();
+    return 0;
+}
+
+// Fixed work with no memory traffic, stands in for a frame of emulation or rendering.
+static uint32_t SpinWork(uint64_t iterations) {
+    uint32_t x = 1;
+    for (uint64_t i = 0; i < iterations; i++)
+        x = x * 1664525u + 1013904223u;
+    return x;
+}
+
+static uint64_t CalibrateSpin(double ms) {
+    const uint64_t probe = 1 << 22;
+    double start = time_now_d();
+    volatile uint32_t sink = SpinWork(probe);
+    (void)sink;
+    double elapsed = time_now_d() - start;
+    return (uint64_t)(probe * (ms / 1000.0) / elapsed);
+}
+
+struct PlacementResult {
+    FrameTimeHistogram emuTime;
+    FrameTimeHistogram renderInterval;
+};
+
+// An emu thread and a render thread two frames apart, like GLRenderManager with two frames
+// in flight, next to workers that keep every core busy in bursts.
+static PlacementResult RunPlacementPipeline(int frames, uint64_t emuWork, uint64_t renderWork, uint64_t workerWork, int workers) {
+    std::mutex lock;
+    std::condition_variable cond;
+    int queued = 0;
+    std::atomic<bool> stopWorkers(false);
+    std::atomic<int> named(0);
+    PlacementResult result;
+
+    std::vector<std::thread> workerThreads;
+    for (int i = 0; i < workers; i++) {
+        workerThreads.emplace_back([&, i] {
+            char name[16];
+            snprintf(name, sizeof(name), "PoolWorker %d", i);
+            SetCurrentThreadName(name);
+            named++;
+            volatile uint32_t sink = 0;
+            while (!stopWorkers) {
+                sink += SpinWork(workerWork);
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+            }
+        });
+    }
+    while (named < workers)
+        std::this_thread::yield();
+    OpenEmuThreadPlacement::PlaceWorkers();
+
+    std::thread render([&] {
+        OpenEmuThreadPlacement::PlaceCurrentThread(OpenEmuThreadPlacement::Role::RENDER);
+        volatile uint32_t sink = 0;
+        double last = 0.0;
+        for (int i = 0; i < frames; i++) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                cond.wait(guard, [&] { return queued > 0; });
+            }
+            sink += SpinWork(renderWork);
+            double now = time_now_d();
+            if (last != 0.0)
+                result.renderInterval.Add((now - last) * 1000.0);
+            last = now;
+            std::lock_guard<std::mutex> guard(lock);
+            queued--;
+            cond.notify_all();
+        }
+    });
+
+    std::thread emu([&] {
+        OpenEmuThreadPlacement::PlaceCurrentThread(OpenEmuThreadPlacement::Role::EMU);
+        volatile uint32_t sink = 0;
+        for (int i = 0; i < frames; i++) {
+            double start = time_now_d();
+            sink += SpinWork(emuWork);
+            result.emuTime.Add((time_now_d() - start) * 1000.0);
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [&] { return queued < 2; });
+            queued++;
+            cond.notify_all();
+        }
+    });
+
+    emu.join();
+    render.join();
+    stopWorkers = true;
+    for (std::thread &thread : workerThreads)
+        thread.join();
+    return result;
+}
+
+int BenchmarkThreadPlacement() {
+    const int frames = 1200;
+    // Roughly a heavy game: 8 ms of emulation, 4 ms of GL submission per frame.
+    uint64_t emuWork = CalibrateSpin(8.0);
+    uint64_t renderWork = CalibrateSpin(4.0);
+    uint64_t workerWork = CalibrateSpin(2.0);
+    int workers = std::max(1, (int)std::thread::hardware_concurrency());
+
+    const OpenEmuThreadPlacement::Policy policies[] = {
+        OpenEmuThreadPlacement::Policy::OS,
+        OpenEmuThreadPlacement::Policy::PRIORITY,
+        OpenEmuThreadPlacement::Policy::PERFORMANCE,
+    };
+    for (OpenEmuThreadPlacement::Policy policy : policies) {
+        OpenEmuThreadPlacement::SetPolicy(policy);
+        printf("%s\n", OpenEmuThreadPlacement::DescribePlan().c_str());
+        PlacementResult result = RunPlacementPipeline(frames, emuWork, renderWork, workerWork, workers);
+        printf("  emu frame ms:       mean %.3f  stddev %.3f  p99 %.3f  max %.3f\n", result.emuTime.Mean(), result.emuTime.StdDev(),
+            result.emuTime.Percentile(99), result.emuTime.Max());
+        printf("  render interval ms: mean %.3f  stddev %.3f  p99 %.3f  max %.3f\n", result.renderInterval.Mean(), result.renderInterval.StdDev(),
+            result.renderInterval.Percentile(99), result.renderInterval.Max());
+    }
+    OpenEmuThreadPlacement::SetPolicy(OpenEmuThreadPlacement::Policy::OS);
+    return 0;
+}
+
+#if defined(__linux__)
+
+struct ExportReaderResult {
+    uint64_t frames = 0;
+    // Frames the reader never saw, it fell a whole ring behind.
+    uint64_t skipped = 0;
+    uint64_t mismatches = 0;
+};
+
+// What an encoder would do: map the ring read-only and look at each new frame in place.
+static void ReadExportedFrames(const char *name, std::atomic<bool> *done, ExportReaderResult *result) {
+    // The writer creates the object on its first CaptureFrame and sizes it right after.
+    int fd = -1;
+    struct stat st = {};
+    while (!*done) {
+        fd = shm_open(name, O_RDONLY, 0);
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(OpenEmuFrameExport::SharedHeader))
+            break;
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (fd < 0)
+        return;
+    const uint8_t *base = (const uint8_t *)mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return;
+
+    const OpenEmuFrameExport::SharedHeader *header = (const OpenEmuFrameExport::SharedHeader *)base;
+    while (memcmp(header->magic, "OEFX", 4) != 0 && !*done)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    uint64_t next = 0;
+    uint64_t lastFrame = UINT64_MAX;
+    while (!*done || next < header->published.load(std::memory_order_acquire)) {
+        uint64_t published = header->published.load(std::memory_order_acquire);
+        if (next >= published) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+        if (published - next > header->slotCount)
+            next = published - header->slotCount;
+
+        const uint8_t *slot = base + header->slotOffset + (size_t)(next % header->slotCount) * header->slotBytes;
+        const OpenEmuFrameExport::SlotHeader *slotHeader = (const OpenEmuFrameExport::SlotHeader *)slot;
+        uint32_t seq = slotHeader->seq.load(std::memory_order_acquire);
+        uint64_t frame = slotHeader->frame;
+        // The frame number is in the clear color, check a pixel in the middle.
+        const uint8_t *pixel = slot + header->pixelOffset + (size_t)header->stride * (header->height / 2) + (header->width / 2) * 4;
+        uint8_t red = pixel[0];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((seq & 1) != 0 || slotHeader->seq.load(std::memory_order_relaxed) != seq) {
+            // Overwritten while we looked, we're too slow.
+            next++;
+            continue;
+        }
+
+        if (lastFrame != UINT64_MAX && frame > lastFrame + 1)
+            result->skipped += frame - lastFrame - 1;
+        if (red != (uint8_t)(frame & 0xFF))
+            result->mismatches++;
+        lastFrame = frame;
+        result->frames++;
+        next++;
+    }
+    munmap((void *)base, st.st_size);
+}
+
+int BenchmarkFrameExport() {
+    // Only for making the context current, everything draws into an FBO.
+    if (!CreateOffscreenGLContext(16, 16)) {
+        fprintf(stderr, "No EGL context, try EGL_PLATFORM=surfaceless\n");
+        return 1;
+    }
+    printf("frame export on %s\n", (const char *)glGetString(GL_RENDERER));
+
+    // The plugin's host FBO size.
+    const int width = 480;
+    const int height = 272;
+    const int frames = 3600;
+    const char *name = "/ppsspp-export-bench";
+
+    GLuint texture, fbo;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+    OpenEmuFrameExport::Configure(name, width, height);
+    std::atomic<bool> done(false);
+    ExportReaderResult reader;
+    std::thread readerThread(&ReadExportedFrames, name, &done, &reader);
+
+    double start = time_now_d();
+    for (int i = 0; i < frames; i++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glClearColor((i & 0xFF) / 255.0f, 0.25f, 0.5f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        OpenEmuFrameExport::CaptureFrame(fbo);
+    }
+    glFinish();
+    double elapsed = time_now_d() - start;
+
+    // Publishes the readbacks glFinish just completed. The reader keeps its own mapping, so
+    // it can drain the ring after the name is gone.
+    OpenEmuFrameExport::Shutdown();
+    OpenEmuFrameExport::Stats stats = OpenEmuFrameExport::GetStats();
+    done = true;
+    readerThread.join();
+
+    printf("frames:   %llu presented, %llu published, %llu dropped in %.2f s (%.0f fps)\n", (unsigned long long)stats.presented,
+        (unsigned long long)stats.published, (unsigned long long)stats.dropped, elapsed, stats.presented / elapsed);
+    printf("capture:  %.3f ms/frame, max %.3f ms on the host thread\n", stats.captureMs / stats.presented, stats.maxCaptureMs);
+    printf("reader:   %llu frames, %llu skipped, %llu wrong pixels\n", (unsigned long long)reader.frames, (unsigned long long)reader.skipped,
+        (unsigned long long)reader.mismatches);
+    return reader.mismatches == 0 ? 0 : 1;
+}
+
+#else
+
+int BenchmarkFrameExport() {
+    fprintf(stderr, "The frame export benchmark needs EGL, it only builds on Linux\n");
+    return 1;
+}
+
+#endif
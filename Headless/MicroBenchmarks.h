@@ -0,0 +1,22 @@
+#pragma once
+
+// Benchmarks of individual pieces of the OpenEmu glue that don't need a booted game.
+// Each one prints its results to stdout and returns a process exit code.
+
+int BenchmarkResampler();
+
+// Cost per message on the logging thread, synchronous stdio vs AsyncLogListener.
+int BenchmarkLogging();
+
+// Decompression throughput and reader stall time for a CSO image, sequential and random
+// reads, with every miss decompressed synchronously vs CsoFileLoader's prefetching.
+int BenchmarkCsoReads(const char *image);
+
+// Frame time variance of a synthetic emu/render pipeline next to busy workers, under each
+// OpenEmuThreadPlacement policy. Pinning only happens on Linux.
+int BenchmarkThreadPlacement();
+
+// OpenEmuFrameExport against an offscreen EGL context, with a reader thread checking what
+// arrives in the shared memory ring. Linux only, meant for Mesa's llvmpipe on machines
+// without a GPU (EGL_PLATFORM=surfaceless).
+int BenchmarkFrameExport();
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Common/GraphicsContext.h"
+
+// A graphics context without a draw context. NativeInitGraphics skips all GL
+// setup when it gets one of these, and the GPU falls back to software
+// rendering into emulated VRAM with nothing being presented.
+class NullGraphicsContext : public GraphicsContext {
+public:
+    void Shutdown() override {}
+    void SwapInterval(int interval) override {}
+    void SwapBuffers() override {}
+    void Resize() override {}
+
+    Draw::DrawContext *GetDrawContext() override { return nullptr; }
+};
@@ -0,0 +1,6 @@
+#pragma once
+
+// Makes a GL 3.2 core context current on the calling thread, with a pbuffer of the given
+// size as the default framebuffer. EGL, so Linux only, meant for Mesa's llvmpipe on
+// machines without a GPU (EGL_PLATFORM=surfaceless). Returns false everywhere else.
+bool CreateOffscreenGLContext(int width, int height);
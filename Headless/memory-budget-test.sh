@@ -0,0 +1,58 @@
+#!/bin/sh
+# Scripted run for --memory-budget, registered with CTest by CMakeLists.txt:
+#
+#   memory-budget-test.sh <PPSSPPHeadless> <image>
+#
+# Records a movie of the image, then replays it under the budget, which has to pass: the
+# peak resident size over the replay stays within budget and the replay stays in sync.
+# Then replays it under a budget nothing can meet, which has to fail, so a passing run
+# means the check actually looked. Without an image the test is skipped (exit 77).
+#
+#   PPSSPP_TEST_BUDGET_MB  the budget (default 512)
+#   PPSSPP_TEST_FRAMES     frames to record and replay (default 1800)
+#   PPSSPP_TEST_ASSETS     PPSSPP's assets directory, if the binary doesn't find its own
+
+set -u
+
+headless=$1
+image=${2:-}
+budget=${PPSSPP_TEST_BUDGET_MB:-512}
+frames=${PPSSPP_TEST_FRAMES:-1800}
+
+if [ -z "$image" ]; then
+    echo "No image, configure with -DPPSSPP_TEST_IMAGE=<image> to run this test"
+    exit 77
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+run() {
+    if [ -n "${PPSSPP_TEST_ASSETS:-}" ]; then
+        "$headless" --frames "$frames" --warmup 60 --memstick "$work/memstick" --assets "$PPSSPP_TEST_ASSETS" "$@" "$image" > "$work/out.txt"
+    else
+        "$headless" --frames "$frames" --warmup 60 --memstick "$work/memstick" "$@" "$image" > "$work/out.txt"
+    fi
+}
+
+if ! run --record-movie "$work/run.oemv"; then
+    echo "FAIL: recording the movie failed"
+    exit 1
+fi
+
+run --replay-movie "$work/run.oemv" --memory-budget "$budget"
+result=$?
+cat "$work/out.txt"
+if [ $result -ne 0 ]; then
+    echo "FAIL: replay under the $budget MB budget exited with $result"
+    exit 1
+fi
+
+run --replay-movie "$work/run.oemv" --memory-budget 1
+result=$?
+if [ $result -ne 1 ]; then
+    echo "FAIL: replay under a 1 MB budget exited with $result, expected 1"
+    exit 1
+fi
+
+echo "PASS: peak resident size stayed within $budget MB over $frames frames"
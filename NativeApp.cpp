@@ -26,8 +26,12 @@
  */
 
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include "Thread/ThreadUtil.h"
+#include "Common/Thread/ThreadManager.h"
+#include "Common/TimeUtil.h"
 
 #include "Common/LogManager.h"
 #include "Common/CPUDetect.h"
@@ -62,22 +66,28 @@
 
 #include "UI/OnScreenDisplay.h"
 
-#include <stdio.h>
-
-inline const char *removePath(const char *str) {
-	const char *slash = strrchr(str, '/');
-	return slash ? (slash + 1) : str;
-}
+#include "OpenEmuAudio.h"
+#include "OpenEmuCoreThread.h"
+#include "OpenEmuDynamicResolution.h"
+#include "OpenEmuFastForward.h"
+#include "OpenEmuFrameExport.h"
+#include "OpenEmuFramePacer.h"
+#include "OpenEmuGeDump.h"
+#include "OpenEmuInflightFrames.h"
+#include "OpenEmuInput.h"
+#include "OpenEmuInputMovie.h"
+#include "OpenEmuJitCache.h"
+#include "OpenEmuLog.h"
+#include "OpenEmuMemory.h"
+#include "OpenEmuPerfCounters.h"
+#include "OpenEmuRewind.h"
+#include "OpenEmuRunAhead.h"
+#include "OpenEmuSaveState.h"
+#include "OpenEmuShaderCache.h"
+#include "OpenEmuStartupTrace.h"
+#include "OpenEmuThreadPlacement.h"
 
-#ifdef _DEBUG
-#define DLOG(...) {printf("D: %s:%i: ", removePath(__FILE__), __LINE__); printf("D: " __VA_ARGS__); printf("\n");}
-#else
-#define DLOG(...)
-#endif
-#define ILOG(...) {printf("I: %s:%i: ", removePath(__FILE__), __LINE__); printf(__VA_ARGS__); printf("\n");}
-#define WLOG(...) {printf("W: %s:%i: ", removePath(__FILE__), __LINE__); printf(__VA_ARGS__); printf("\n");}
-#define ELOG(...) {printf("E: %s:%i: ", removePath(__FILE__), __LINE__); printf(__VA_ARGS__); printf("\n");}
-#define FLOG(...) {printf("F: %s:%i: ", removePath(__FILE__), __LINE__); printf(__VA_ARGS__); printf("\n"); Crash();}
+#include <stdio.h>
 
 KeyInput input_state;
 OnScreenMessages osm;
@@ -87,112 +97,243 @@ static Draw::Pipeline *colorPipeline;
 static Draw::Pipeline *texColorPipeline;
 
 namespace OpenEmuCoreThread {
+    // Null when running headless, see NativeInitGraphics.
     OpenEmuGLContext *ctx;
 
-    enum class EmuThreadState {
-        DISABLED,
-        START_REQUESTED,
-        RUNNING,
-        PAUSE_REQUESTED,
-        PAUSED,
-        QUIT_REQUESTED,
-        STOPPED,
-    };
-
     static std::thread emuThread;
     static bool threadStarted = false;
-    static std::atomic<EmuThreadState> emuThreadState(EmuThreadState::DISABLED);
 
-    static void EmuFrame() {
+    // Only written with stateLock held so waiters can't miss a transition. It stays
+    // atomic so NativeRender can check for PAUSED without taking the lock.
+    static std::atomic<EmuThreadState> emuThreadState(EmuThreadState::DISABLED);
+    static std::mutex stateLock;
+    static std::condition_variable stateCond;
 
-        ctx->SetRenderTarget();
+    // Set while the emu thread is inside EmuFrame or tearing down the render manager.
+    // In both cases it may block until the host thread runs frames, so anyone waiting
+    // for a transition has to keep calling ThreadFrame while this is set.
+    static bool needsThreadFrame = false;
 
-        if (ctx->GetDrawContext()) {
-            ctx->GetDrawContext()->BeginFrame();
-        }
+    static TransitionStats transitionStats;
 
-        gpu->BeginHostFrame();
+    static void SetState(EmuThreadState state) {
+        emuThreadState = state;
+        stateCond.notify_all();
+    }
 
+    static void RunCoreFrame() {
         coreState = CORE_RUNNING;
+        OpenEmuPerfCounters::ScopedTimer timer(OpenEmuPerfCounters::Counter::RUN_LOOP);
         PSP_RunLoopUntil(UINT64_MAX);
+    }
+
+    // With run-ahead on this emulates several frames, all of them inside this one host
+    // frame so the render manager still only sees a single frame.
+    static void RunAheadFrame() {
+        OpenEmuRunAhead::RunFrame(&RunCoreFrame, &OpenEmuAudio::Produce);
+    }
 
-        gpu->EndHostFrame();
+    static void EmuFrame() {
+        // Before the pacer's wait so precompiling can use the time it would sleep.
+        OpenEmuJitCache::OnFrameBoundary();
+        // Waits for this frame's deadline. PPSSPP's own frame limiter still runs inside
+        // PSP_RunLoopUntil, but it's aiming for the same cadence so it rarely has to wait.
+        OpenEmuFramePacer::BeginFrame();
+        OpenEmuJitCache::BeginFrame();
+
+        Draw::DrawContext *draw = ctx ? ctx->GetDrawContext() : nullptr;
+
+        int inflightFrames = OpenEmuInflightFrames::BeginFrame();
+        if (ctx) {
+            if (inflightFrames != 0)
+                ctx->SetInflightFrames(inflightFrames);
+            ctx->SetRenderTarget();
+        }
 
-        if (ctx->GetDrawContext()) {
-            ctx->GetDrawContext()->EndFrame();
+        if (draw) {
+            draw->BeginFrame();
         }
+
+        // Before BeginHostFrame, which is where a new render size takes effect.
+        OpenEmuDynamicResolution::BeginFrame();
+        {
+            OpenEmuPerfCounters::ScopedTimer timer(OpenEmuPerfCounters::Counter::BEGIN_HOST_FRAME);
+            gpu->BeginHostFrame();
+        }
+
+        // Between two emulated frames, the same spot SaveState::Process runs from. Memory
+        // first, rewind drops its oldest snapshots right away if the budget got shrunk.
+        OpenEmuMemory::OnFrameBoundary();
+        OpenEmuRewind::OnFrameBoundary();
+        OpenEmuSaveState::OnFrameBoundary();
+        OpenEmuGeDump::OnFrameBoundary();
+        // Input queued by the host since the last frame, the whole frame sees the same state.
+        OpenEmuInput::ApplyPending();
+        // Records that input, or replaces it with a movie's.
+        OpenEmuInputMovie::OnFrameBoundary();
+
+        // Fast-forwarding skips run-ahead, the extra latency it hides isn't noticeable at
+        // several times real speed.
+        OpenEmuFastForward::RunHostFrame(&RunAheadFrame, &RunCoreFrame, &OpenEmuAudio::Produce);
+
+        {
+            OpenEmuPerfCounters::ScopedTimer timer(OpenEmuPerfCounters::Counter::END_HOST_FRAME);
+            gpu->EndHostFrame();
+        }
+
+        if (draw) {
+            draw->EndFrame();
+        }
+
+        OpenEmuInflightFrames::EndFrame();
+        OpenEmuJitCache::EndFrame();
+        OpenEmuShaderCache::EndFrame();
+        OpenEmuFramePacer::EndFrame();
+        OpenEmuPerfCounters::EndFrame();
+        OpenEmuInput::EndFrame(ctx != nullptr);
     }
 
     static void EmuThreadFunc() {
 		SetCurrentThreadName("Emu");
+        OpenEmuThreadPlacement::PlaceCurrentThread(OpenEmuThreadPlacement::Role::EMU);
+        // The workers have all named themselves by now.
+        OpenEmuThreadPlacement::PlaceWorkers();
 
+        std::unique_lock<std::mutex> lock(stateLock);
         while (true) {
             switch ((EmuThreadState)emuThreadState) {
                 case EmuThreadState::START_REQUESTED:
-                    threadStarted = true;
-                    emuThreadState = EmuThreadState::RUNNING;
+                    SetState(EmuThreadState::RUNNING);
                     /* fallthrough */
                 case EmuThreadState::RUNNING:
+                    needsThreadFrame = true;
+                    lock.unlock();
                     EmuFrame();
+                    lock.lock();
+                    needsThreadFrame = false;
+                    stateCond.notify_all();
                     break;
                 case EmuThreadState::PAUSE_REQUESTED:
-                    emuThreadState = EmuThreadState::PAUSED;
+                    SetState(EmuThreadState::PAUSED);
                     /* fallthrough */
                 case EmuThreadState::PAUSED:
-                    usleep(1000);
+                    stateCond.wait(lock, [] { return emuThreadState != EmuThreadState::PAUSED; });
                     break;
                 default:
                 case EmuThreadState::QUIT_REQUESTED:
-                    emuThreadState = EmuThreadState::STOPPED;
-                    ctx->StopThread();
+                    needsThreadFrame = true;
+                    lock.unlock();
+                    if (ctx) {
+                        ctx->StopThread();
+                    }
+                    lock.lock();
+                    needsThreadFrame = false;
+                    SetState(EmuThreadState::STOPPED);
                     return;
             }
         }
     }
 
+    // Blocks until the emu thread acknowledges reaching `state`. Must be called from the
+    // thread that owns the render manager (the one calling NativeRender).
+    static void WaitForState(std::unique_lock<std::mutex> &lock, EmuThreadState state) {
+        while (emuThreadState != state) {
+            if (needsThreadFrame && ctx) {
+                lock.unlock();
+                bool running = ctx->ThreadFrame();
+                if (running)
+                    OpenEmuInput::OnFramePresented();
+                lock.lock();
+                if (!running) {
+                    // The render manager is gone, there is nothing left to run.
+                    stateCond.wait(lock, [state] { return emuThreadState == state; });
+                }
+            } else {
+                stateCond.wait(lock);
+            }
+        }
+    }
+
     void EmuThreadStart() {
-        bool wasPaused = emuThreadState == EmuThreadState::PAUSED;
-        emuThreadState = EmuThreadState::START_REQUESTED;
+        std::unique_lock<std::mutex> lock(stateLock);
+
+        if (emuThreadState == EmuThreadState::PAUSED) {
+            // The old deadlines are long gone, don't count the pause as a late frame.
+            OpenEmuFramePacer::Resync();
+            double start = time_now_d();
+            SetState(EmuThreadState::START_REQUESTED);
+            stateCond.wait(lock, [] { return emuThreadState != EmuThreadState::START_REQUESTED; });
+
+            transitionStats.lastResumeMs = (time_now_d() - start) * 1000.0;
+            if (OpenEmuPerfCounters::IsEnabled())
+                OpenEmuPerfCounters::Add(OpenEmuPerfCounters::Counter::RESUME, (uint64_t)(transitionStats.lastResumeMs * 1e6));
+            transitionStats.resumes++;
+            DEBUG_LOG(SYSTEM, "Emu thread resumed in %.3f ms", transitionStats.lastResumeMs);
+            return;
+        }
 
-        if (!wasPaused) {
+        // Also covers a resume requested from the emu thread itself, e.g. from a save state callback.
+        if (threadStarted) {
+            return;
+        }
+
+        threadStarted = true;
+        SetState(EmuThreadState::START_REQUESTED);
+        lock.unlock();
+
+        if (ctx) {
+            // This is the thread that runs ThreadFrame.
+            OpenEmuThreadPlacement::PlaceCurrentThread(OpenEmuThreadPlacement::Role::RENDER);
             ctx->ThreadStart();
-            emuThread = std::thread(&EmuThreadFunc);
         }
+        emuThread = std::thread(&EmuThreadFunc);
     }
 
     void EmuThreadStop() {
-        if (emuThreadState != EmuThreadState::RUNNING) {
+        std::unique_lock<std::mutex> lock(stateLock);
+        if (!threadStarted) {
             return;
         }
 
-        emuThreadState = EmuThreadState::QUIT_REQUESTED;
+        SetState(EmuThreadState::QUIT_REQUESTED);
+        WaitForState(lock, EmuThreadState::STOPPED);
+        threadStarted = false;
+        lock.unlock();
 
-        while (ctx->ThreadFrame()) {
-            // Need to keep eating frames to allow the EmuThread to exit correctly.
-            continue;
-        }
         emuThread.join();
         emuThread = std::thread();
-        ctx->ThreadEnd();
+        if (ctx) {
+            ctx->ThreadEnd();
+        }
     }
 
     void EmuThreadPause() {
-        if (emuThreadState != EmuThreadState::RUNNING) {
+        std::unique_lock<std::mutex> lock(stateLock);
+        if (emuThreadState != EmuThreadState::RUNNING && emuThreadState != EmuThreadState::START_REQUESTED) {
             return;
         }
-        emuThreadState = EmuThreadState::PAUSE_REQUESTED;
 
-        while (emuThreadState != EmuThreadState::PAUSED) {
-            //We need to process frames until the thread Pauses give 10 ms between loops
-            ctx->ThreadFrame();
-            emuThreadState = EmuThreadState::PAUSE_REQUESTED;
-            usleep(10000);
+        double start = time_now_d();
+        SetState(EmuThreadState::PAUSE_REQUESTED);
+        WaitForState(lock, EmuThreadState::PAUSED);
+
+        transitionStats.lastPauseMs = (time_now_d() - start) * 1000.0;
+        if (transitionStats.lastPauseMs > transitionStats.maxPauseMs) {
+            transitionStats.maxPauseMs = transitionStats.lastPauseMs;
         }
+        transitionStats.pauses++;
+        if (OpenEmuPerfCounters::IsEnabled())
+            OpenEmuPerfCounters::Add(OpenEmuPerfCounters::Counter::PAUSE, (uint64_t)(transitionStats.lastPauseMs * 1e6));
+        DEBUG_LOG(SYSTEM, "Emu thread paused in %.3f ms", transitionStats.lastPauseMs);
     }
 
-    static void EmuThreadJoin() {
-        emuThread.join();
-        emuThread = std::thread();
+    TransitionStats GetTransitionStats() {
+        std::lock_guard<std::mutex> guard(stateLock);
+        return transitionStats;
+    }
+
+    EmuThreadState GetState() {
+        return emuThreadState;
     }
 }  // namespace OpenEmuCoreThread
 
@@ -200,35 +341,8 @@ namespace OpenEmuCoreThread {
 // Here's where we store the OpenEmu framebuffer to bind for final rendering
 int framebuffer = 0;
 
-class AndroidLogger : public LogListener
-{
-public:
-    void Log(const LogMessage &msg) override{};
-
-	void Log(LogTypes::LOG_LEVELS level, const char *msg)
-	{
-		switch (level)
-		{
-            case LogTypes::LVERBOSE:
-            case LogTypes::LDEBUG:
-            case LogTypes::LINFO:
-                ILOG("%s", msg);
-                break;
-            case LogTypes::LERROR:
-                ELOG("%s", msg);
-                break;
-            case LogTypes::LWARNING:
-                WLOG("%s", msg);
-                break;
-            case LogTypes::LNOTICE:
-            default:
-                ILOG("%s", msg);
-                break;
-		}
-	}
-};
-
-static AndroidLogger *logger = 0;
+// Replaces LogManager's console output, which wrote synchronously from whatever thread logged.
+static AsyncLogListener *logger = nullptr;
 
 class NativeHost : public Host {
 public:
@@ -259,21 +373,55 @@ public:
 
 int NativeMix(short *audio, int num_samples)
 {
+    OpenEmuPerfCounters::ScopedTimer timer(OpenEmuPerfCounters::Counter::AUDIO_MIX);
     int sample_rate = System_GetPropertyInt(SYSPROP_AUDIO_SAMPLE_RATE);
     num_samples = __AudioMix(audio, num_samples, sample_rate > 0 ? sample_rate : 44100);
 
 	return num_samples;
 }
-bool CreateGlobalPipelines();
+
+// glslang setup is slow and nothing needs it before the GPU is created, so it runs on the
+// pool while the graphics context and the game load come up.
+static std::mutex shaderTranslationLock;
+static std::condition_variable shaderTranslationCond;
+static bool shaderTranslationReady = false;
+
+class ShaderTranslationInitTask : public Task {
+public:
+    TaskType Type() const override { return TaskType::CPU_COMPUTE; }
+    TaskPriority Priority() const override { return TaskPriority::HIGH; }
+
+    void Run() override {
+        {
+            OpenEmuStartupTrace::ScopedStep step("ShaderTranslationInit");
+            ShaderTranslationInit();
+        }
+        std::lock_guard<std::mutex> guard(shaderTranslationLock);
+        shaderTranslationReady = true;
+        shaderTranslationCond.notify_all();
+    }
+};
+
+static void WaitForShaderTranslation() {
+    std::unique_lock<std::mutex> lock(shaderTranslationLock);
+    shaderTranslationCond.wait(lock, [] { return shaderTranslationReady; });
+}
 
 void NativeInit(int argc, const char *argv[], const char *savegame_directory, const char *external_directory, const char *cache_directory)
 {
-    VFSRegister("", new DirectoryAssetReader(Path("assets/")));
-    VFSRegister("", new DirectoryAssetReader(Path(external_directory)));
+    OpenEmuStartupTrace::ScopedStep step("NativeInit");
 
-    ShaderTranslationInit();
-    
     g_threadManager.Init(cpu_info.num_cores, cpu_info.logical_cpu_count);
+    OpenEmuThreadPlacement::PlaceWorkers();
+
+    shaderTranslationReady = false;
+    g_threadManager.EnqueueTask(new ShaderTranslationInitTask());
+
+    {
+        OpenEmuStartupTrace::ScopedStep vfs("VFSRegister");
+        VFSRegister("", new DirectoryAssetReader(Path("assets/")));
+        VFSRegister("", new DirectoryAssetReader(Path(external_directory)));
+    }
 
     DiskCachingFileLoaderCache::SetCacheDir(g_Config.appCacheDirectory);
     
@@ -282,8 +430,13 @@ void NativeInit(int argc, const char *argv[], const char *savegame_directory, co
     }
 
 	LogManager *logman = LogManager::GetInstance();
-	ILOG("Logman: %p", logman);
+    if (!logger) {
+        logger = new AsyncLogListener(stderr);
+        logman->RemoveListener(logman->GetConsoleListener());
+        logman->AddListener(logger);
+    }
 
+    // Release builds compile out everything past warnings anyway, see MAX_LOGLEVEL.
     LogTypes::LOG_LEVELS logLevel = LogTypes::LINFO;
 	for(int i = 0; i < LogTypes::NUMBER_OF_LOGS; i++)
 	{
@@ -293,16 +446,35 @@ void NativeInit(int argc, const char *argv[], const char *savegame_directory, co
 }
 
 void NativeSetThreadState(OpenEmuCoreThread::EmuThreadState threadState)  {
-    if(threadState == OpenEmuCoreThread::EmuThreadState::PAUSE_REQUESTED && OpenEmuCoreThread::threadStarted)
-        OpenEmuCoreThread::EmuThreadPause();
-    else if(threadState == OpenEmuCoreThread::EmuThreadState::START_REQUESTED && !OpenEmuCoreThread::threadStarted)
-        OpenEmuCoreThread::EmuThreadStart();
-    else
-        OpenEmuCoreThread::emuThreadState = threadState;
+    switch (threadState) {
+        case OpenEmuCoreThread::EmuThreadState::START_REQUESTED:
+            // Starts the thread the first time, resumes it after that.
+            OpenEmuCoreThread::EmuThreadStart();
+            break;
+        case OpenEmuCoreThread::EmuThreadState::PAUSE_REQUESTED:
+            OpenEmuCoreThread::EmuThreadPause();
+            break;
+        case OpenEmuCoreThread::EmuThreadState::QUIT_REQUESTED:
+            OpenEmuCoreThread::EmuThreadStop();
+            break;
+        default:
+            break;
+    }
 }
 
 bool NativeInitGraphics(GraphicsContext *graphicsContext)
 {
+    OpenEmuStartupTrace::ScopedStep step("NativeInitGraphics");
+
+    // Headless hosts pass a context without a draw context, there is no GL to set up.
+    if (!graphicsContext->GetDrawContext()) {
+        OpenEmuCoreThread::ctx = nullptr;
+        Core_SetGraphicsContext(graphicsContext);
+        g_draw = nullptr;
+        WaitForShaderTranslation();
+        return true;
+    }
+
     //Set the Core Thread graphics Context
     OpenEmuCoreThread::ctx = static_cast<OpenEmuGLContext*>(graphicsContext);
 
@@ -313,11 +485,10 @@ bool NativeInitGraphics(GraphicsContext *graphicsContext)
     Core_SetGraphicsContext(OpenEmuCoreThread::ctx);
     g_draw = graphicsContext->GetDrawContext();
 
-    CreateGlobalPipelines();
-
     if (gpu)
         gpu->DeviceRestore();
 
+    WaitForShaderTranslation();
     return true;
 }
 
@@ -328,42 +499,34 @@ void NativeRender(GraphicsContext *ctx)
     if(OpenEmuCoreThread::emuThreadState == OpenEmuCoreThread::EmuThreadState::PAUSED)
         return;
 
-    OpenEmuCoreThread::ctx->ThreadFrame();
+    double start = time_now_d();
+    {
+        OpenEmuPerfCounters::ScopedTimer timer(OpenEmuPerfCounters::Counter::THREAD_FRAME);
+        OpenEmuDynamicResolution::BeginGpuFrame();
+        OpenEmuCoreThread::ctx->ThreadFrame();
+        OpenEmuDynamicResolution::EndGpuFrame();
+    }
+    OpenEmuShaderCache::RecordHostFrame((time_now_d() - start) * 1000.0);
+    // Queued before the swap, while the frame is still in the FBO.
+    OpenEmuFrameExport::CaptureFrame(framebuffer);
     OpenEmuCoreThread::ctx->SwapBuffers();
+    OpenEmuInput::OnFramePresented();
+    OpenEmuStartupTrace::FirstFrame();
+    double presentMs = (time_now_d() - start) * 1000.0;
+    OpenEmuFramePacer::RecordPresent(presentMs);
+    OpenEmuInflightFrames::RecordPresent(presentMs);
 }
 
 void NativeUpdate() {}
 
-bool CreateGlobalPipelines() {
-    using namespace Draw;
-
-    ShaderModule *vs_color_2d = g_draw->GetVshaderPreset(VS_COLOR_2D);
-    ShaderModule *fs_color_2d = g_draw->GetFshaderPreset(FS_COLOR_2D);
-    ShaderModule *vs_texture_color_2d = g_draw->GetVshaderPreset(VS_TEXTURE_COLOR_2D);
-    ShaderModule *fs_texture_color_2d = g_draw->GetFshaderPreset(FS_TEXTURE_COLOR_2D);
-
-    if (!vs_color_2d || !fs_color_2d || !vs_texture_color_2d || !fs_texture_color_2d) {
-        ERROR_LOG(G3D, "Failed to get shader preset");
-        return false;
-    }
-
-    //InputLayout *inputLayout = ui_draw2d.CreateInputLayout(g_draw);
-    BlendState *blendNormal = g_draw->CreateBlendState({ true, 0xF, BlendFactor::SRC_ALPHA, BlendFactor::ONE_MINUS_SRC_ALPHA });
-    DepthStencilState *depth = g_draw->CreateDepthStencilState({ false, false, Comparison::LESS });
-    RasterState *rasterNoCull = g_draw->CreateRasterState({});
-
-    // Release these now, reference counting should ensure that they get completely released
-    // once we delete both pipelines.
-   
-    rasterNoCull->Release();
-    blendNormal->Release();
-    depth->Release();
-    return true;
+void NativeFrame() {
+    OpenEmuCoreThread::EmuFrame();
 }
 
-
 void NativeShutdownGraphics()
 {
+    OpenEmuFrameExport::Shutdown();
+    OpenEmuDynamicResolution::Shutdown();
 }
 
 void NativeShutdown()
@@ -371,6 +534,12 @@ void NativeShutdown()
     delete host;
     host = 0;
 
+    if (logger) {
+        LogManager::GetInstance()->RemoveListener(logger);
+        // Writes out whatever is still queued.
+        delete logger;
+        logger = nullptr;
+    }
     LogManager::Shutdown();
 }
 
@@ -0,0 +1,272 @@
+#include "OpenEmuAudio.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Common/TimeUtil.h"
+
+int NativeMix(short *audio, int num_samples);
+
+static const int CHANNELS = 2;
+static const int CORE_RATE = 44100;
+static const double FRAME_RATE = 59.94;
+// The ring is sized once, for a quarter second at this rate. Far more than we ever want
+// buffered, the target stays well below.
+static const int MAX_OUTPUT_RATE = 48000;
+
+AudioRingBuffer::AudioRingBuffer(size_t capacityFrames) : writePos_(0), readPos_(0), clearTo_(NO_CLEAR) {
+    size_t capacity = 1;
+    while (capacity < capacityFrames)
+        capacity <<= 1;
+    mask_ = capacity - 1;
+    buffer_.resize(capacity * CHANNELS);
+}
+
+size_t AudioRingBuffer::Write(const int16_t *frames, size_t count) {
+    size_t write = writePos_.load(std::memory_order_relaxed);
+    size_t read = readPos_.load(std::memory_order_acquire);
+    count = std::min(count, Capacity() - (write - read));
+
+    size_t offset = write & mask_;
+    size_t first = std::min(count, Capacity() - offset);
+    memcpy(&buffer_[offset * CHANNELS], frames, first * CHANNELS * sizeof(int16_t));
+    memcpy(&buffer_[0], frames + first * CHANNELS, (count - first) * CHANNELS * sizeof(int16_t));
+
+    writePos_.store(write + count, std::memory_order_release);
+    return count;
+}
+
+size_t AudioRingBuffer::Read(int16_t *frames, size_t count) {
+    size_t read = readPos_.load(std::memory_order_relaxed);
+    size_t write = writePos_.load(std::memory_order_acquire);
+    size_t clearTo = clearTo_.exchange(NO_CLEAR, std::memory_order_acquire);
+    // Only ever forward, a clear from before this read already happened.
+    if (clearTo != NO_CLEAR && clearTo - read <= write - read)
+        read = clearTo;
+    count = std::min(count, write - read);
+
+    size_t offset = read & mask_;
+    size_t first = std::min(count, Capacity() - offset);
+    memcpy(frames, &buffer_[offset * CHANNELS], first * CHANNELS * sizeof(int16_t));
+    memcpy(frames + first * CHANNELS, &buffer_[0], (count - first) * CHANNELS * sizeof(int16_t));
+
+    readPos_.store(read + count, std::memory_order_release);
+    return count;
+}
+
+void AudioRingBuffer::Clear() {
+    clearTo_.store(writePos_.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+size_t AudioRingBuffer::Available() const {
+    return writePos_.load(std::memory_order_acquire) - readPos_.load(std::memory_order_acquire);
+}
+
+namespace OpenEmuAudio {
+    // Never freed, the host's audio thread may be inside Consume at any time.
+    static AudioRingBuffer ring(MAX_OUTPUT_RATE / 4);
+    static std::atomic<bool> running(false);
+    // Emu thread, or with it stopped.
+    static AudioResampler *resampler = nullptr;
+    static double coreFramesPending = 0.0;
+    static std::vector<int16_t> mixBuffer;
+    static std::vector<int16_t> resampleBuffer;
+    static std::atomic<double> rateCorrection(1.0);
+    static std::atomic<int> decimation(1);
+
+    // Box filter state carried between Produce calls while decimating.
+    static int lastDecimation = 1;
+    static int32_t decimationSum[CHANNELS];
+    static int decimationCount = 0;
+
+    // Written by the consumer, read by the producer.
+    static std::atomic<uint32_t> targetFrames(0);
+    // Written by Init, the consumer picks the new rate up when the generation changes.
+    static std::atomic<int> outputRate(44100);
+    static std::atomic<uint32_t> generation(0);
+
+    static std::atomic<uint64_t> underruns(0);
+    static std::atomic<uint64_t> underrunFrames(0);
+    static std::atomic<uint64_t> overruns(0);
+    static std::atomic<uint64_t> droppedFrames(0);
+    static std::atomic<double> callbackJitter(0.0);
+
+    // Consumer thread only, reset by Consume itself when Init started a new generation.
+    static uint32_t consumerGeneration = 0;
+    static int consumerRate = 44100;
+    static size_t framesPerEmuFrame = 0;
+    static double lastCallback = 0.0;
+    static double meanInterval = 0.0;
+    static double jitter = 0.0;
+    static double underrunPadding = 0.0;
+
+    void Init(int sampleRate, AudioResampler::Quality quality) {
+        Shutdown();
+
+        resampler = new AudioResampler(CORE_RATE, sampleRate, quality);
+        coreFramesPending = 0.0;
+        mixBuffer.resize((size_t)ceil(CORE_RATE / FRAME_RATE) * 2 * CHANNELS);
+        resampleBuffer.resize(resampler->OutputFramesFor(mixBuffer.size() / CHANNELS) * CHANNELS);
+        rateCorrection = 1.0;
+        decimation = 1;
+        lastDecimation = 1;
+        decimationCount = 0;
+
+        targetFrames = (uint32_t)(ceil(sampleRate / FRAME_RATE) * 2);
+        underruns = 0;
+        underrunFrames = 0;
+        overruns = 0;
+        droppedFrames = 0;
+        callbackJitter = 0.0;
+
+        outputRate = sampleRate;
+        generation++;
+        running = true;
+    }
+
+    void Shutdown() {
+        running = false;
+        // Whatever the last game left in there isn't played at the start of the next one.
+        ring.Clear();
+        delete resampler;
+        resampler = nullptr;
+    }
+
+    void SetDecimation(int factor) {
+        decimation = std::max(0, factor);
+    }
+
+    // Averages every `factor` input frames into one, in place. Returns the output count.
+    static int Decimate(int16_t *samples, int frames, int factor) {
+        int out = 0;
+        for (int i = 0; i < frames; i++) {
+            decimationSum[0] += samples[i * CHANNELS];
+            decimationSum[1] += samples[i * CHANNELS + 1];
+            if (++decimationCount == factor) {
+                samples[out * CHANNELS] = (int16_t)(decimationSum[0] / factor);
+                samples[out * CHANNELS + 1] = (int16_t)(decimationSum[1] / factor);
+                out++;
+                decimationSum[0] = 0;
+                decimationSum[1] = 0;
+                decimationCount = 0;
+            }
+        }
+        return out;
+    }
+
+    void Produce() {
+        if (!resampler)
+            return;
+
+        // Always take exactly one emulated frame's worth from the core, asking for more than it
+        // produced would only pad with silence. The depth of the ring is controlled by nudging
+        // the resampling ratio instead.
+        coreFramesPending += CORE_RATE / FRAME_RATE;
+        int coreFrames = (int)coreFramesPending;
+        coreFramesPending -= coreFrames;
+
+        double buffered = (double)ring.Available();
+        double target = (double)targetFrames.load(std::memory_order_relaxed);
+        double error = target > 0.0 ? (target - buffered) / target : 0.0;
+        double correction = 1.0 + 0.005 * std::max(-1.0, std::min(1.0, error));
+        resampler->SetRateCorrection(correction);
+        rateCorrection.store(correction, std::memory_order_relaxed);
+
+        int mixed = NativeMix(&mixBuffer[0], coreFrames);
+
+        int factor = decimation.load(std::memory_order_relaxed);
+        if (factor != lastDecimation) {
+            decimationSum[0] = 0;
+            decimationSum[1] = 0;
+            decimationCount = 0;
+            lastDecimation = factor;
+        }
+        if (factor == 0) {
+            // Muted, but keep the ring at its depth with silence so leaving fast-forward
+            // doesn't start with an underrun. There may be many calls per host frame here.
+            if (buffered >= target)
+                return;
+            memset(&mixBuffer[0], 0, mixed * CHANNELS * sizeof(int16_t));
+        } else if (factor > 1) {
+            mixed = Decimate(&mixBuffer[0], mixed, factor);
+        }
+
+        size_t produced = resampler->Process(&mixBuffer[0], mixed, &resampleBuffer[0], resampleBuffer.size() / CHANNELS);
+
+        size_t written = ring.Write(&resampleBuffer[0], produced);
+        if (written < produced) {
+            overruns++;
+            droppedFrames += produced - written;
+        }
+    }
+
+    size_t Consume(void *buffer, size_t bytes) {
+        size_t requested = bytes / (CHANNELS * sizeof(int16_t));
+        size_t read = ring.Read((int16_t *)buffer, requested);
+        bool active = running.load(std::memory_order_acquire);
+
+        // Init ran since the last callback, the timing history belongs to the last game.
+        uint32_t currentGeneration = generation.load(std::memory_order_acquire);
+        if (currentGeneration != consumerGeneration) {
+            consumerGeneration = currentGeneration;
+            consumerRate = outputRate.load(std::memory_order_relaxed);
+            framesPerEmuFrame = (size_t)ceil(consumerRate / FRAME_RATE);
+            lastCallback = 0.0;
+            meanInterval = 0.0;
+            jitter = 0.0;
+            underrunPadding = 0.0;
+        }
+
+        if (read < requested) {
+            memset((int16_t *)buffer + read * CHANNELS, 0, (requested - read) * CHANNELS * sizeof(int16_t));
+            if (active) {
+                underruns++;
+                underrunFrames += requested - read;
+                // Back off after an underrun, this decays again below.
+                underrunPadding += (double)framesPerEmuFrame / 2;
+            }
+        }
+
+        if (!active)
+            return read * CHANNELS * sizeof(int16_t);
+
+        double now = time_now_d();
+        if (lastCallback != 0.0) {
+            double interval = now - lastCallback;
+            if (meanInterval == 0.0)
+                meanInterval = interval;
+            meanInterval += (interval - meanInterval) * 0.05;
+            jitter += (fabs(interval - meanInterval) - jitter) * 0.05;
+        }
+        lastCallback = now;
+        underrunPadding *= 0.999;
+
+        // Enough to cover the next request, one emulated frame of production granularity,
+        // and a few deviations of callback timing.
+        double target = requested + framesPerEmuFrame + 4.0 * jitter * consumerRate + underrunPadding;
+        target = std::min(target, (double)(ring.Capacity() - framesPerEmuFrame * 2));
+        targetFrames.store((uint32_t)target, std::memory_order_relaxed);
+        callbackJitter.store(jitter * 1000.0, std::memory_order_relaxed);
+
+        return read * CHANNELS * sizeof(int16_t);
+    }
+
+    size_t TargetBufferBytes() {
+        return targetFrames.load(std::memory_order_relaxed) * CHANNELS * sizeof(int16_t);
+    }
+
+    Stats GetStats() {
+        Stats stats;
+        stats.underruns = underruns;
+        stats.underrunFrames = underrunFrames;
+        stats.overruns = overruns;
+        stats.droppedFrames = droppedFrames;
+        stats.bufferedFrames = (uint32_t)ring.Available();
+        stats.targetFrames = targetFrames;
+        stats.callbackJitterMs = callbackJitter;
+        stats.rateCorrection = rateCorrection;
+        stats.memoryBytes = (mixBuffer.size() + resampleBuffer.size()) * sizeof(int16_t) + ring.Capacity() * CHANNELS * sizeof(int16_t);
+        return stats;
+    }
+} // namespace OpenEmuAudio
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "OpenEmuResampler.h"
+
+// Lock-free single producer / single consumer ring of interleaved stereo s16 frames.
+// The emu thread writes, the host audio callback reads.
+class AudioRingBuffer {
+public:
+    // Capacity gets rounded up to a power of two.
+    explicit AudioRingBuffer(size_t capacityFrames);
+
+    // Producer side. Returns the number of frames actually written.
+    size_t Write(const int16_t *frames, size_t count);
+    // Consumer side. Returns the number of frames actually read.
+    size_t Read(int16_t *frames, size_t count);
+
+    // Any thread, while the producer is idle. The consumer drops everything written so far
+    // at its next Read, so neither side ever has the buffer pulled out from under it.
+    void Clear();
+
+    size_t Available() const;
+    size_t Capacity() const { return mask_ + 1; }
+
+private:
+    static const size_t NO_CLEAR = ~(size_t)0;
+
+    std::vector<int16_t> buffer_;
+    size_t mask_;
+    // Separate cache lines, each side only ever stores to its own.
+    alignas(64) std::atomic<size_t> writePos_;
+    alignas(64) std::atomic<size_t> readPos_;
+    // Write position the consumer skips ahead to, NO_CLEAR when there's nothing to drop.
+    std::atomic<size_t> clearTo_;
+};
+
+namespace OpenEmuAudio {
+    struct Stats {
+        uint64_t underruns;
+        uint64_t underrunFrames;
+        uint64_t overruns;
+        uint64_t droppedFrames;
+        uint32_t bufferedFrames;
+        uint32_t targetFrames;
+        double callbackJitterMs;
+        double rateCorrection;
+        // The ring plus the mix and resample buffers.
+        uint64_t memoryBytes;
+    };
+
+    // The core always mixes at 44100 Hz, this resamples to outputRate on the emu thread.
+    // Both with the emu thread stopped or paused. The ring the host audio callback reads
+    // from lives as long as the process, these only empty it.
+    void Init(int outputRate, AudioResampler::Quality quality);
+    void Shutdown();
+
+    // Emu thread, once per emulated frame. Mixes one frame of audio and resamples it with a
+    // slight rate correction that keeps the ring at its target depth.
+    void Produce();
+
+    // Fast-forward: average every `factor` core frames into one so the output keeps its
+    // rate while covering `factor` times the game time. 1 is normal, 0 outputs silence.
+    void SetDecimation(int factor);
+
+    // Host audio callback. Never touches the core, only copies out of the ring and pads
+    // with silence on underrun. Returns the number of bytes that came from the ring.
+    size_t Consume(void *buffer, size_t bytes);
+
+    // Current target depth in bytes, adapts to the jitter of the audio callback.
+    size_t TargetBufferBytes();
+
+    Stats GetStats();
+} // namespace OpenEmuAudio
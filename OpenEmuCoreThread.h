@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+namespace OpenEmuCoreThread {
+    enum class EmuThreadState {
+        DISABLED,
+        START_REQUESTED,
+        RUNNING,
+        PAUSE_REQUESTED,
+        PAUSED,
+        QUIT_REQUESTED,
+        STOPPED,
+    };
+
+    // How long the last pause / resume took from request until the emu thread acknowledged it.
+    struct TransitionStats {
+        double lastPauseMs = 0.0;
+        double maxPauseMs = 0.0;
+        double lastResumeMs = 0.0;
+        uint32_t pauses = 0;
+        uint32_t resumes = 0;
+    };
+
+    TransitionStats GetTransitionStats();
+
+    EmuThreadState GetState();
+} // namespace OpenEmuCoreThread
+
+// START_REQUESTED starts or resumes the emu thread, PAUSE_REQUESTED and QUIT_REQUESTED
+// pause or stop it. All three block until the emu thread acknowledged the change.
+void NativeSetThreadState(OpenEmuCoreThread::EmuThreadState threadState);
+
+// Runs a single emulated frame on the calling thread. Only used by hosts that
+// don't start the emu thread, like the headless benchmark runner.
+void NativeFrame();
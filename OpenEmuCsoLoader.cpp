@@ -0,0 +1,364 @@
+#include "OpenEmuCsoLoader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+#include "Common/Log.h"
+#include "Common/Thread/ThreadManager.h"
+#include "Common/TimeUtil.h"
+
+// Blocks are usually 2 KB, decompressing them one task at a time would cost more in
+// queueing than in inflate.
+static const size_t CHUNK_BYTES = 64 * 1024;
+static const size_t CACHE_BYTES = 16 * 1024 * 1024;
+// How far ahead of a forward reader to decompress, and how many chunks may be queued.
+static const uint32_t PREFETCH_CHUNKS = 8;
+static const int MAX_IN_FLIGHT = 8;
+
+static const uint32_t NO_CHUNK = 0xFFFFFFFF;
+static const size_t HEADER_SIZE = 24;
+
+namespace OpenEmuCsoLoader {
+    static std::atomic<uint64_t> reads(0);
+    static std::atomic<uint64_t> bytesRead(0);
+    static std::atomic<uint64_t> hits(0);
+    static std::atomic<uint64_t> prefetchWaits(0);
+    static std::atomic<uint64_t> syncDecodes(0);
+    static std::atomic<uint64_t> stallMicros(0);
+    static std::atomic<uint64_t> prefetchedChunks(0);
+    static std::atomic<uint64_t> decodeErrors(0);
+    static std::atomic<uint64_t> memoryBytes(0);
+
+    bool IsSupported(const uint8_t *header, size_t size) {
+        if (size < HEADER_SIZE || memcmp(header, "CISO", 4) != 0)
+            return false;
+        uint32_t blockSize;
+        memcpy(&blockSize, header + 16, 4);
+        uint8_t version = header[20];
+        // v2 mixes in LZ4 blocks, leave those to PPSSPP.
+        return version <= 1 && blockSize >= 512 && blockSize <= CHUNK_BYTES && (blockSize & (blockSize - 1)) == 0;
+    }
+} // namespace OpenEmuCsoLoader
+
+class ChunkDecodeTask : public Task {
+public:
+    ChunkDecodeTask(CsoFileLoader *loader, uint32_t chunk, int slot) : loader_(loader), chunk_(chunk), slot_(slot) {}
+
+    TaskType Type() const override { return TaskType::CPU_COMPUTE; }
+    TaskPriority Priority() const override { return TaskPriority::NORMAL; }
+
+    void Run() override {
+        loader_->Decode(chunk_, loader_->slots_[slot_].data);
+        std::lock_guard<std::mutex> guard(loader_->lock_);
+        loader_->Publish(slot_);
+        loader_->inFlight_--;
+        OpenEmuCsoLoader::prefetchedChunks++;
+    }
+
+private:
+    CsoFileLoader *loader_;
+    uint32_t chunk_;
+    int slot_;
+};
+
+CsoFileLoader::CsoFileLoader(FileLoader *backend, bool prefetch) : backend_(backend), prefetch_(prefetch), useClock_(0) {
+    uint8_t header[HEADER_SIZE];
+    if (backend_->ReadAt(0, HEADER_SIZE, header) != HEADER_SIZE || !OpenEmuCsoLoader::IsSupported(header, HEADER_SIZE))
+        return;
+
+    uint64_t totalBytes;
+    memcpy(&totalBytes, header + 8, 8);
+    memcpy(&blockSize_, header + 16, 4);
+    indexShift_ = header[21];
+    totalBytes_ = (s64)totalBytes;
+    numBlocks_ = (uint32_t)((totalBytes + blockSize_ - 1) / blockSize_);
+
+    index_.resize(numBlocks_ + 1);
+    size_t indexBytes = index_.size() * sizeof(uint32_t);
+    if (backend_->ReadAt(HEADER_SIZE, indexBytes, &index_[0]) != indexBytes) {
+        ERROR_LOG(LOADER, "CSO index of %s is truncated", backend_->GetPath().c_str());
+        return;
+    }
+    s64 fileSize = backend_->FileSize();
+    for (uint32_t i = 0; i < numBlocks_; i++) {
+        uint64_t start = (uint64_t)(index_[i] & 0x7FFFFFFF) << indexShift_;
+        uint64_t end = (uint64_t)(index_[i + 1] & 0x7FFFFFFF) << indexShift_;
+        if (end < start || (s64)end > fileSize) {
+            ERROR_LOG(LOADER, "CSO index of %s is corrupt at block %u", backend_->GetPath().c_str(), i);
+            return;
+        }
+    }
+
+    blocksPerChunk_ = (uint32_t)(CHUNK_BYTES / blockSize_);
+    chunkBytes_ = (size_t)blocksPerChunk_ * blockSize_;
+    numChunks_ = (numBlocks_ + blocksPerChunk_ - 1) / blocksPerChunk_;
+
+    numSlots_ = (int)std::min<size_t>(CACHE_BYTES / chunkBytes_, numChunks_);
+    storage_.resize((size_t)numSlots_ * chunkBytes_);
+    slots_.reset(new Slot[numSlots_]);
+    for (int i = 0; i < numSlots_; i++) {
+        slots_[i].seq = 0;
+        slots_[i].chunk = NO_CHUNK;
+        slots_[i].lastUse = 0;
+        slots_[i].data = &storage_[(size_t)i * chunkBytes_];
+    }
+    chunkSlot_.reset(new std::atomic<int32_t>[numChunks_]);
+    for (uint32_t i = 0; i < numChunks_; i++)
+        chunkSlot_[i] = -1;
+
+    valid_ = true;
+    OpenEmuCsoLoader::memoryBytes += MemoryBytes();
+    INFO_LOG(LOADER, "CSO %s: %u blocks of %u bytes, %d cache slots of %zu KB", backend_->GetPath().c_str(), numBlocks_, blockSize_,
+        numSlots_, chunkBytes_ / 1024);
+}
+
+CsoFileLoader::~CsoFileLoader() {
+    // Tasks write into our slots, wait them out.
+    std::unique_lock<std::mutex> lock(lock_);
+    cond_.wait(lock, [this] { return inFlight_ == 0; });
+    if (valid_)
+        OpenEmuCsoLoader::memoryBytes -= MemoryBytes();
+}
+
+size_t CsoFileLoader::MemoryBytes() const {
+    return storage_.size() + index_.size() * sizeof(uint32_t) + (size_t)numChunks_ * sizeof(std::atomic<int32_t>);
+}
+
+Path CsoFileLoader::GetPath() const {
+    return backend_->GetPath();
+}
+
+size_t CsoFileLoader::ReadAt(s64 absolutePos, size_t bytes, void *data, Flags flags) {
+    if (!valid_ || absolutePos < 0 || absolutePos >= totalBytes_ || bytes == 0)
+        return 0;
+    bytes = (size_t)std::min<s64>(bytes, totalBytes_ - absolutePos);
+
+    uint64_t pos = (uint64_t)absolutePos;
+    uint32_t first = (uint32_t)(pos / chunkBytes_);
+    uint32_t last = (uint32_t)((pos + bytes - 1) / chunkBytes_);
+
+    if (prefetch_) {
+        // A read spanning chunks gets them decompressed in parallel. A read carrying on from
+        // the last one also gets the chunks after it started.
+        bool forward = lastChunk_ != NO_CHUNK && (first == lastChunk_ || first == lastChunk_ + 1);
+        if (forward)
+            Prefetch(first, std::min(last + PREFETCH_CHUNKS, numChunks_ - 1));
+        else if (last > first)
+            Prefetch(first, last);
+    }
+    lastChunk_ = last;
+
+    uint8_t *dest = (uint8_t *)data;
+    size_t remaining = bytes;
+    for (uint32_t chunk = first; chunk <= last; chunk++) {
+        size_t offset = chunk == first ? (size_t)(pos % chunkBytes_) : 0;
+        size_t count = std::min(remaining, chunkBytes_ - offset);
+        CopyFromChunk(chunk, offset, count, dest);
+        dest += count;
+        remaining -= count;
+    }
+
+    OpenEmuCsoLoader::reads++;
+    OpenEmuCsoLoader::bytesRead += bytes;
+    return bytes;
+}
+
+bool CsoFileLoader::TryCopy(uint32_t chunk, size_t offset, size_t bytes, uint8_t *dest) {
+    int32_t index = chunkSlot_[chunk].load(std::memory_order_acquire);
+    if (index < 0)
+        return false;
+
+    Slot &slot = slots_[index];
+    uint32_t seq = slot.seq.load(std::memory_order_acquire);
+    if ((seq & 1) != 0 || slot.chunk.load(std::memory_order_relaxed) != chunk)
+        return false;
+    memcpy(dest, slot.data + offset, bytes);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != seq)
+        return false;
+
+    slot.lastUse.store(useClock_.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
+}
+
+void CsoFileLoader::CopyFromChunk(uint32_t chunk, size_t offset, size_t bytes, uint8_t *dest) {
+    if (TryCopy(chunk, offset, bytes, dest)) {
+        OpenEmuCsoLoader::hits++;
+        return;
+    }
+
+    double start = time_now_d();
+    bool waited = false;
+    bool decoded = false;
+    std::unique_lock<std::mutex> lock(lock_);
+    while (!TryCopy(chunk, offset, bytes, dest)) {
+        int32_t index = chunkSlot_[chunk].load(std::memory_order_relaxed);
+        if (index >= 0 && (slots_[index].seq.load(std::memory_order_relaxed) & 1) != 0) {
+            // Already being decompressed, by a task or another reader.
+            waited = true;
+            cond_.wait(lock);
+            continue;
+        }
+
+        index = Reserve(chunk);
+        if (index < 0) {
+            cond_.wait(lock);
+            continue;
+        }
+        lock.unlock();
+        Decode(chunk, slots_[index].data);
+        lock.lock();
+        Publish(index);
+        decoded = true;
+    }
+    lock.unlock();
+
+    if (decoded)
+        OpenEmuCsoLoader::syncDecodes++;
+    else if (waited)
+        OpenEmuCsoLoader::prefetchWaits++;
+    else
+        OpenEmuCsoLoader::hits++;
+    OpenEmuCsoLoader::stallMicros += (uint64_t)((time_now_d() - start) * 1e6);
+}
+
+void CsoFileLoader::Prefetch(uint32_t from, uint32_t to) {
+    std::unique_lock<std::mutex> lock(lock_, std::defer_lock);
+    for (uint32_t chunk = from; chunk <= to; chunk++) {
+        // Cached or on its way, no need to lock for that.
+        if (chunkSlot_[chunk].load(std::memory_order_relaxed) >= 0)
+            continue;
+        if (!lock.owns_lock())
+            lock.lock();
+        if (inFlight_ >= MAX_IN_FLIGHT)
+            break;
+        if (chunkSlot_[chunk].load(std::memory_order_relaxed) >= 0)
+            continue;
+        int index = Reserve(chunk);
+        if (index < 0)
+            break;
+        inFlight_++;
+        g_threadManager.EnqueueTask(new ChunkDecodeTask(this, chunk, index));
+    }
+}
+
+int CsoFileLoader::Reserve(uint32_t chunk) {
+    int victim = -1;
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < numSlots_; i++) {
+        const Slot &slot = slots_[i];
+        if ((slot.seq.load(std::memory_order_relaxed) & 1) != 0)
+            continue;
+        if (slot.chunk.load(std::memory_order_relaxed) == NO_CHUNK) {
+            victim = i;
+            break;
+        }
+        uint64_t lastUse = slot.lastUse.load(std::memory_order_relaxed);
+        if (lastUse < oldest) {
+            oldest = lastUse;
+            victim = i;
+        }
+    }
+    if (victim < 0)
+        return -1;
+
+    Slot &slot = slots_[victim];
+    uint32_t evicted = slot.chunk.load(std::memory_order_relaxed);
+    if (evicted != NO_CHUNK)
+        chunkSlot_[evicted].store(-1, std::memory_order_relaxed);
+
+    // Odd from here until Publish, readers racing with the refill see the change and miss.
+    slot.seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.chunk.store(chunk, std::memory_order_relaxed);
+    slot.lastUse.store(useClock_.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    chunkSlot_[chunk].store(victim, std::memory_order_release);
+    return victim;
+}
+
+void CsoFileLoader::Publish(int slot) {
+    slots_[slot].seq.fetch_add(1, std::memory_order_release);
+    cond_.notify_all();
+}
+
+void CsoFileLoader::Decode(uint32_t chunk, uint8_t *dest) {
+    uint32_t firstBlock = chunk * blocksPerChunk_;
+    uint32_t endBlock = std::min(firstBlock + blocksPerChunk_, numBlocks_);
+    uint64_t start = (uint64_t)(index_[firstBlock] & 0x7FFFFFFF) << indexShift_;
+    uint64_t end = (uint64_t)(index_[endBlock] & 0x7FFFFFFF) << indexShift_;
+
+    // The chunk's blocks are contiguous in the file, one read gets all of them.
+    thread_local std::vector<uint8_t> compressed;
+    compressed.resize((size_t)(end - start));
+    if (backend_->ReadAt(start, compressed.size(), compressed.data()) != compressed.size()) {
+        ERROR_LOG(LOADER, "Short read of CSO chunk %u", chunk);
+        memset(dest, 0, chunkBytes_);
+        OpenEmuCsoLoader::decodeErrors++;
+        return;
+    }
+
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, -15) != Z_OK) {
+        memset(dest, 0, chunkBytes_);
+        OpenEmuCsoLoader::decodeErrors++;
+        return;
+    }
+
+    for (uint32_t block = firstBlock; block < endBlock; block++) {
+        uint8_t *out = dest + (size_t)(block - firstBlock) * blockSize_;
+        uint64_t blockStart = ((uint64_t)(index_[block] & 0x7FFFFFFF) << indexShift_) - start;
+        uint64_t blockEnd = ((uint64_t)(index_[block + 1] & 0x7FFFFFFF) << indexShift_) - start;
+        size_t size = (size_t)(blockEnd - blockStart);
+
+        if ((index_[block] & 0x80000000) != 0) {
+            // Stored uncompressed, possibly followed by alignment padding.
+            size_t count = std::min<size_t>(size, blockSize_);
+            memcpy(out, &compressed[blockStart], count);
+            memset(out + count, 0, blockSize_ - count);
+            continue;
+        }
+
+        inflateReset(&z);
+        z.next_in = &compressed[blockStart];
+        z.avail_in = (uInt)size;
+        z.next_out = out;
+        z.avail_out = blockSize_;
+        int result = inflate(&z, Z_FINISH);
+        if (result != Z_STREAM_END && z.avail_out != 0) {
+            ERROR_LOG(LOADER, "CSO block %u failed to inflate (%d)", block, result);
+            memset(out, 0, blockSize_);
+            OpenEmuCsoLoader::decodeErrors++;
+        }
+    }
+    inflateEnd(&z);
+}
+
+namespace OpenEmuCsoLoader {
+    Stats GetStats() {
+        Stats stats;
+        stats.reads = reads;
+        stats.bytesRead = bytesRead;
+        stats.hits = hits;
+        stats.prefetchWaits = prefetchWaits;
+        stats.syncDecodes = syncDecodes;
+        stats.stallMs = stallMicros / 1000.0;
+        stats.prefetchedChunks = prefetchedChunks;
+        stats.decodeErrors = decodeErrors;
+        stats.memoryBytes = memoryBytes;
+        return stats;
+    }
+
+    void ResetStats() {
+        reads = 0;
+        bytesRead = 0;
+        hits = 0;
+        prefetchWaits = 0;
+        syncDecodes = 0;
+        stallMicros = 0;
+        prefetchedChunks = 0;
+        decodeErrors = 0;
+    }
+} // namespace OpenEmuCsoLoader
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Common/File/Path.h"
+#include "Core/Loaders.h"
+
+// CSO (CISO v0/v1) images presented as the plain ISO they decompress to, so PPSSPP's own
+// block device never inflates anything on the emu thread. Blocks are decompressed a chunk
+// at a time into a fixed size LRU cache. When reads go forward, the chunks ahead of them
+// are decompressed in parallel on g_threadManager. Reads of cached chunks don't lock, a
+// seqlock on each slot catches the rare eviction racing with the copy.
+class CsoFileLoader : public FileLoader {
+public:
+    // Takes ownership of backend, which must allow concurrent ReadAt calls (LocalFileLoader
+    // does). With prefetch off every miss is decompressed synchronously, like stock PPSSPP.
+    explicit CsoFileLoader(FileLoader *backend, bool prefetch = true);
+    ~CsoFileLoader();
+
+    // Whether the header and index made sense. Nothing else works if this is false.
+    bool IsValid() const { return valid_; }
+
+    bool Exists() override { return valid_; }
+    bool IsDirectory() override { return false; }
+    s64 FileSize() override { return totalBytes_; }
+    Path GetPath() const override;
+    std::string GetFileExtension() const override { return ".iso"; }
+    size_t ReadAt(s64 absolutePos, size_t bytes, void *data, Flags flags = Flags::NONE) override;
+
+private:
+    struct Slot {
+        // Odd while the slot is being (re)filled.
+        std::atomic<uint32_t> seq;
+        std::atomic<uint32_t> chunk;
+        std::atomic<uint64_t> lastUse;
+        uint8_t *data;
+    };
+
+    friend class ChunkDecodeTask;
+
+    // The cache and the block index, all allocated up front.
+    size_t MemoryBytes() const;
+
+    bool TryCopy(uint32_t chunk, size_t offset, size_t bytes, uint8_t *dest);
+    void CopyFromChunk(uint32_t chunk, size_t offset, size_t bytes, uint8_t *dest);
+    // Queues decompression of the chunks in [from, to] that aren't cached yet.
+    void Prefetch(uint32_t from, uint32_t to);
+    // Under lock_. Returns -1 if every slot is being filled.
+    int Reserve(uint32_t chunk);
+    void Publish(int slot);
+    void Decode(uint32_t chunk, uint8_t *dest);
+
+    std::unique_ptr<FileLoader> backend_;
+    bool prefetch_;
+    bool valid_ = false;
+
+    s64 totalBytes_ = 0;
+    uint32_t blockSize_ = 0;
+    uint32_t numBlocks_ = 0;
+    int indexShift_ = 0;
+    std::vector<uint32_t> index_;
+
+    uint32_t blocksPerChunk_ = 0;
+    size_t chunkBytes_ = 0;
+    uint32_t numChunks_ = 0;
+
+    std::vector<uint8_t> storage_;
+    std::unique_ptr<Slot[]> slots_;
+    int numSlots_ = 0;
+    // Chunk -> slot, -1 when not cached. Written under lock_, read without.
+    std::unique_ptr<std::atomic<int32_t>[]> chunkSlot_;
+    std::atomic<uint64_t> useClock_;
+
+    // Emu thread only.
+    uint32_t lastChunk_ = 0xFFFFFFFF;
+
+    std::mutex lock_;
+    std::condition_variable cond_;
+    int inFlight_ = 0;
+};
+
+namespace OpenEmuCsoLoader {
+    struct Stats {
+        uint64_t reads;
+        uint64_t bytesRead;
+        // Chunk lookups served straight from the cache.
+        uint64_t hits;
+        // Misses where a prefetch was already running and the reader waited for it.
+        uint64_t prefetchWaits;
+        // Misses decompressed on the reading thread.
+        uint64_t syncDecodes;
+        // Time the reading thread spent on misses, waiting or decompressing.
+        double stallMs;
+        uint64_t prefetchedChunks;
+        uint64_t decodeErrors;
+        // Held by the open loaders, not reset by ResetStats.
+        uint64_t memoryBytes;
+    };
+
+    // Whether the first bytes of a file are a CSO header this loader can decode.
+    bool IsSupported(const uint8_t *header, size_t size);
+
+    Stats GetStats();
+    void ResetStats();
+} // namespace OpenEmuCsoLoader
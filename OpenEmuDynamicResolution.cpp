@@ -0,0 +1,249 @@
+#include "OpenEmuDynamicResolution.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#if defined(__APPLE__)
+#include "Common/GPU/OpenGL/GLCommon.h"
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+#include "Common/Log.h"
+#include "Core/Config.h"
+#include "Core/System.h"
+#include "GPU/GPUInterface.h"
+
+namespace OpenEmuDynamicResolution {
+    // Half a second of frames per decision.
+    static const uint32_t WINDOW = 30;
+    // The first frames after a change pay for recreating the framebuffers, and the
+    // render thread may still be on frames from before it.
+    static const uint32_t SETTLE_FRAMES = 4;
+    // Going up must leave this much of the target spare, by the pixel count estimate.
+    static const double UP_HEADROOM = 0.85;
+    static const int UP_WINDOWS = 2;
+    // Frames before trying to go up again after a change, doubled when a step up had to
+    // be taken back within PROBE_FRAMES.
+    static const uint64_t UP_HOLD = 120;
+    static const uint64_t MAX_UP_HOLD = 120 * 16;
+    static const uint64_t PROBE_FRAMES = 600;
+    static const size_t MAX_CHANGES = 64;
+
+    // Results are read back this many frames later at the earliest.
+    static const int NUM_QUERIES = 4;
+    // Some drivers return garbage for the first query after the context is created.
+    static const double MAX_SAMPLE_MS = 1000.0;
+
+    struct Query {
+        GLuint id;
+        int scale;
+    };
+
+    static std::atomic<bool> enabled(false);
+    static std::atomic<int> appliedScale(0);
+
+    static std::mutex lock;
+    static Stats stats;
+    static bool configChanged = false;
+    static int minScale = MIN_SCALE;
+    static int maxScale = MIN_SCALE;
+    static int startScale = MIN_SCALE;
+    static double targetMs = 12.0;
+    // GPU time at the current scale since the last decision.
+    static double windowSum = 0.0;
+    static uint32_t windowCount = 0;
+    static uint32_t settleFrames = 0;
+
+    // Host thread only.
+    static Query queries[NUM_QUERIES];
+    static bool queriesCreated = false;
+    static int queryHead = 0;
+    static int queryCount = 0;
+    static bool queryActive = false;
+
+    // Emu thread only.
+    static int scale = 0;
+    static uint64_t frame = 0;
+    static uint64_t lastChange = 0;
+    static uint64_t lastUp = 0;
+    static uint64_t upHold = UP_HOLD;
+    static int goodWindows = 0;
+
+    void Configure(int minimum, int maximum, int start, double target) {
+        std::lock_guard<std::mutex> guard(lock);
+        minScale = std::min(std::max(minimum, MIN_SCALE), MAX_SCALE);
+        maxScale = std::min(std::max(maximum, minScale), MAX_SCALE);
+        startScale = std::min(std::max(start, minScale), maxScale);
+        if (target > 0.0)
+            targetMs = target;
+        configChanged = true;
+        enabled = true;
+    }
+
+    bool IsEnabled() {
+        return enabled;
+    }
+
+    // Under lock.
+    static void AddSample(double ms, int sampleScale) {
+        stats.frames++;
+        stats.framesAtScale[sampleScale]++;
+        stats.gpuTime.Add(ms);
+        double &mean = stats.meanGpuMsAtScale[sampleScale];
+        mean += (ms - mean) / (double)stats.framesAtScale[sampleScale];
+        if (ms > targetMs)
+            stats.overBudgetAtScale[sampleScale]++;
+
+        if (sampleScale != appliedScale)
+            return;
+        if (settleFrames > 0) {
+            settleFrames--;
+            return;
+        }
+        windowSum += ms;
+        windowCount++;
+    }
+
+    static void CollectResults() {
+        while (queryCount > 0) {
+            Query &query = queries[queryHead];
+            GLint available = 0;
+            glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+            GLuint64 nanos = 0;
+            glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &nanos);
+            if (nanos / 1e6 < MAX_SAMPLE_MS) {
+                std::lock_guard<std::mutex> guard(lock);
+                AddSample(nanos / 1e6, query.scale);
+            }
+            queryHead = (queryHead + 1) % NUM_QUERIES;
+            queryCount--;
+        }
+    }
+
+    void BeginGpuFrame() {
+        int current = appliedScale;
+        if (!enabled || current == 0)
+            return;
+        if (!queriesCreated) {
+            GLuint ids[NUM_QUERIES];
+            glGenQueries(NUM_QUERIES, ids);
+            for (int i = 0; i < NUM_QUERIES; i++)
+                queries[i].id = ids[i];
+            queriesCreated = true;
+        }
+
+        CollectResults();
+        // Every query still pending, skip measuring this frame rather than wait.
+        if (queryCount == NUM_QUERIES)
+            return;
+        Query &query = queries[(queryHead + queryCount) % NUM_QUERIES];
+        query.scale = current;
+        glBeginQuery(GL_TIME_ELAPSED, query.id);
+        queryActive = true;
+    }
+
+    void EndGpuFrame() {
+        if (!queryActive)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        queryActive = false;
+        queryCount++;
+    }
+
+    void Shutdown() {
+        if (queriesCreated) {
+            GLuint ids[NUM_QUERIES];
+            for (int i = 0; i < NUM_QUERIES; i++)
+                ids[i] = queries[i].id;
+            glDeleteQueries(NUM_QUERIES, ids);
+            queriesCreated = false;
+        }
+        queryHead = 0;
+        queryCount = 0;
+        queryActive = false;
+    }
+
+    // Under lock.
+    static void ChangeScale(int to, double gpuMs) {
+        Change change;
+        change.frame = frame;
+        change.from = scale;
+        change.to = to;
+        change.gpuMsBefore = gpuMs;
+        change.gpuMsAfter = 0.0;
+        if (stats.changes.size() == MAX_CHANGES)
+            stats.changes.erase(stats.changes.begin());
+        stats.changes.push_back(change);
+        // NOTICE, Release builds compile INFO out.
+        if (scale != 0)
+            NOTICE_LOG(G3D, "Render scale %dx -> %dx at frame %llu, GPU %.2f ms against a %.2f ms target", scale, to, (unsigned long long)frame, gpuMs, targetMs);
+
+        scale = to;
+        stats.scale = to;
+        appliedScale = to;
+        lastChange = frame;
+        goodWindows = 0;
+        windowSum = 0.0;
+        windowCount = 0;
+        settleFrames = SETTLE_FRAMES;
+
+        g_Config.iInternalResolution = to;
+        PSP_CoreParameter().renderWidth = 480 * to;
+        PSP_CoreParameter().renderHeight = 272 * to;
+        if (gpu)
+            gpu->NotifyRenderResized();
+    }
+
+    void BeginFrame() {
+        frame++;
+        std::lock_guard<std::mutex> guard(lock);
+        if (configChanged) {
+            configChanged = false;
+            upHold = UP_HOLD;
+            lastUp = 0;
+            ChangeScale(startScale, 0.0);
+            return;
+        }
+        if (!enabled || scale == 0 || windowCount < WINDOW)
+            return;
+
+        double mean = windowSum / windowCount;
+        windowSum = 0.0;
+        windowCount = 0;
+        Change &last = stats.changes.back();
+        if (last.to == scale && last.gpuMsAfter == 0.0) {
+            last.gpuMsAfter = mean;
+            if (last.from != 0)
+                NOTICE_LOG(G3D, "Render scale %dx: GPU %.2f ms, was %.2f ms at %dx", scale, mean, last.gpuMsBefore, last.from);
+        }
+
+        if (mean > targetMs && scale > minScale) {
+            if (lastUp != 0 && frame - lastUp < PROBE_FRAMES)
+                upHold = std::min(upHold * 2, MAX_UP_HOLD);
+            ChangeScale(scale - 1, mean);
+            return;
+        }
+
+        // GPU time goes roughly with the number of pixels.
+        double ratio = (double)(scale + 1) / scale;
+        if (scale < maxScale && mean * ratio * ratio < targetMs * UP_HEADROOM) {
+            goodWindows++;
+            if (goodWindows >= UP_WINDOWS && frame - lastChange >= upHold) {
+                lastUp = frame;
+                ChangeScale(scale + 1, mean);
+            }
+        } else {
+            goodWindows = 0;
+        }
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats;
+    }
+} // namespace OpenEmuDynamicResolution
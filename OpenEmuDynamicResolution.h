@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FrameStats.h"
+
+// Steps the internal render scale (g_Config.iInternalResolution) up and down at runtime
+// to keep the GPU time of a frame under a target. GPU time is measured with GL timer
+// queries around the host's ThreadFrame, read back a few frames later so the host never
+// waits on them.
+//
+// Going down happens as soon as a window of frames at the current scale averages over
+// the target. Going up needs the window's average, scaled by the pixel count of the
+// next step, to fit under UP_HEADROOM of the target for two windows in a row, so the
+// scale doesn't flap between two steps. A step that had to be taken back is retried
+// only after twice as long.
+//
+// Changes go through gpu->NotifyRenderResized, the framebuffers are recreated at the
+// next BeginHostFrame without a DeviceLost/DeviceRestore.
+namespace OpenEmuDynamicResolution {
+    static const int MIN_SCALE = 1;
+    static const int MAX_SCALE = 8;
+
+    struct Change {
+        uint64_t frame;
+        int from;
+        int to;
+        // Mean GPU ms of the window that triggered the change, and of the first full
+        // window at the new scale (0 until there is one).
+        double gpuMsBefore;
+        double gpuMsAfter;
+    };
+
+    struct Stats {
+        int scale;
+        uint64_t frames;
+        // Frames over the target, per scale.
+        uint64_t overBudgetAtScale[MAX_SCALE + 1];
+        uint64_t framesAtScale[MAX_SCALE + 1];
+        double meanGpuMsAtScale[MAX_SCALE + 1];
+        FrameTimeHistogram gpuTime;
+        // The most recent changes, oldest first.
+        std::vector<Change> changes;
+    };
+
+    // Turns it on. maxScale is the host FBO's multiple of 480x272, nothing above it would
+    // be visible. Takes effect on the next frame, starting at startScale.
+    void Configure(int minScale, int maxScale, int startScale, double targetMs);
+    bool IsEnabled();
+
+    // Host thread, with the GL context current, around ThreadFrame.
+    void BeginGpuFrame();
+    void EndGpuFrame();
+    // Host thread, frees the timer queries.
+    void Shutdown();
+
+    // Emu thread, before gpu->BeginHostFrame. Applies a scale change if one is due.
+    void BeginFrame();
+
+    Stats GetStats();
+} // namespace OpenEmuDynamicResolution
@@ -0,0 +1,141 @@
+#include "OpenEmuFastForward.h"
+
+#include <atomic>
+#include <mutex>
+
+#include "Common/Log.h"
+#include "Common/TimeUtil.h"
+#include "Core/System.h"
+#include "GPU/GPUState.h"
+
+#include "OpenEmuAudio.h"
+
+namespace OpenEmuFastForward {
+    // Unbounded keeps emulating until a host frame's worth of time is used up, then presents.
+    static const double UNBOUNDED_BUDGET = 1.0 / 60.0;
+    static const int UNBOUNDED_MAX_FRAMES = 64;
+
+    static std::atomic<int> speed(NORMAL);
+    static std::atomic<bool> forceNormal(false);
+
+    // Emu thread only.
+    static int lastSpeed = NORMAL;
+    static double windowStart = 0.0;
+    static uint32_t windowEmulated = 0;
+    static uint32_t windowHost = 0;
+
+    static std::mutex statsLock;
+    static Stats stats;
+
+    void SetSpeed(int newSpeed) {
+        if (newSpeed != UNBOUNDED) {
+            if (newSpeed >= 8)
+                newSpeed = 8;
+            else if (newSpeed >= 4)
+                newSpeed = 4;
+            else if (newSpeed >= 2)
+                newSpeed = 2;
+            else
+                newSpeed = NORMAL;
+        }
+        speed = newSpeed;
+    }
+
+    void ForceNormal(bool force) {
+        forceNormal = force;
+    }
+
+    int GetSpeed() {
+        return forceNormal ? NORMAL : speed.load();
+    }
+
+    bool IsUnbounded() {
+        return GetSpeed() == UNBOUNDED;
+    }
+
+    int SpeedForRate(double rate) {
+        if (rate <= 1.0)
+            return NORMAL;
+        if (rate <= 2.0)
+            return 2;
+        if (rate <= 4.0)
+            return 4;
+        if (rate <= 8.0)
+            return 8;
+        return UNBOUNDED;
+    }
+
+    static void CountFrames(int emulated) {
+        double now = time_now_d();
+        if (windowStart == 0.0)
+            windowStart = now;
+        windowEmulated += emulated;
+        windowHost++;
+
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.emulatedFrames += emulated;
+        stats.skippedPresents += emulated - 1;
+        if (now - windowStart >= 1.0) {
+            stats.emulatedFps = windowEmulated / (now - windowStart);
+            stats.hostFps = windowHost / (now - windowStart);
+            windowStart = now;
+            windowEmulated = 0;
+            windowHost = 0;
+        }
+    }
+
+    void RunHostFrame(void (*normalFrame)(), void (*runCoreFrame)(), void (*afterFrame)()) {
+        int frames = GetSpeed();
+        if (frames != lastSpeed) {
+            INFO_LOG(SYSTEM, "Fast-forward: speed %d -> %d", lastSpeed, frames);
+            OpenEmuAudio::SetDecimation(frames);
+            lastSpeed = frames;
+        }
+
+        if (frames == NORMAL) {
+            normalFrame();
+            CountFrames(1);
+            return;
+        }
+
+        // Keeps PPSSPP's own frame limiter from sleeping inside the run loop.
+        bool fastForward = PSP_CoreParameter().fastForward;
+        PSP_CoreParameter().fastForward = true;
+
+        double start = time_now_d();
+        int emulated = 0;
+        while (true) {
+            bool last;
+            if (frames == UNBOUNDED) {
+                // The frame that crosses the budget is the one that gets drawn, so guess
+                // from the average frame so far whether this one will.
+                double elapsed = time_now_d() - start;
+                double average = emulated > 0 ? elapsed / emulated : 0.0;
+                last = emulated + 1 >= UNBOUNDED_MAX_FRAMES || elapsed + average * 2.0 >= UNBOUNDED_BUDGET;
+            } else {
+                last = emulated + 1 == frames;
+            }
+
+            if (last)
+                gstate_c.skipDrawReason &= ~SKIPDRAW_SKIPFRAME;
+            else
+                gstate_c.skipDrawReason |= SKIPDRAW_SKIPFRAME;
+
+            runCoreFrame();
+            afterFrame();
+            emulated++;
+            if (last)
+                break;
+        }
+
+        PSP_CoreParameter().fastForward = fastForward;
+        CountFrames(emulated);
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(statsLock);
+        Stats result = stats;
+        result.speed = GetSpeed();
+        return result;
+    }
+} // namespace OpenEmuFastForward
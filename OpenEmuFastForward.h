@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+// Fast-forward at a fixed multiple of real time, or as fast as the emulation goes. Each
+// host frame runs several emulated frames. Only the last of them draws, so the render
+// manager still sees one frame and presents once per host frame. The intermediate
+// frames skip GL submission entirely. Audio is decimated by the same factor, or muted
+// when unbounded.
+namespace OpenEmuFastForward {
+    static const int NORMAL = 1;
+    static const int UNBOUNDED = 0;
+
+    struct Stats {
+        int speed;
+        // Over the last second.
+        double emulatedFps;
+        double hostFps;
+        // Running total.
+        uint64_t emulatedFrames;
+        // Emulated frames that never reached the render manager.
+        uint64_t skippedPresents;
+    };
+
+    // NORMAL, 2, 4, 8 or UNBOUNDED. Anything else gets rounded down to one of those.
+    void SetSpeed(int speed);
+    // While forced, every host frame runs at NORMAL whatever SetSpeed asked for. Input
+    // movies need one boundary per emulated frame. GetSpeed and the rest report NORMAL.
+    void ForceNormal(bool force);
+    int GetSpeed();
+    bool IsUnbounded();
+
+    // Maps OpenEmu's rate onto one of the speeds above.
+    int SpeedForRate(double rate);
+
+    // Emu thread, one host frame. Calls normalFrame when not fast-forwarding, otherwise
+    // runCoreFrame several times with afterFrame after each.
+    void RunHostFrame(void (*normalFrame)(), void (*runCoreFrame)(), void (*afterFrame)());
+
+    Stats GetStats();
+} // namespace OpenEmuFastForward
@@ -0,0 +1,302 @@
+#include "OpenEmuFileLoader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Common/Log.h"
+#include "Common/Thread/ThreadUtil.h"
+#include "Common/TimeUtil.h"
+#include "Core/FileLoaders/LocalFileLoader.h"
+
+#include "OpenEmuCsoLoader.h"
+#include "OpenEmuThreadPlacement.h"
+
+// Read-ahead starts after this many back to back reads and doubles its window each time
+// the reader catches up, up to the maximum.
+static const int SEQUENTIAL_THRESHOLD = 2;
+static const size_t MIN_WINDOW = 512 * 1024;
+static const size_t MAX_WINDOW = 8 * 1024 * 1024;
+
+// Darwin declares mincore's vector as char *, Linux as unsigned char *.
+#ifdef __APPLE__
+typedef char MincoreVec;
+#else
+typedef unsigned char MincoreVec;
+#endif
+
+namespace OpenEmuFileLoader {
+    static std::atomic<uint64_t> reads(0);
+    static std::atomic<uint64_t> bytesRead(0);
+    static std::atomic<uint64_t> stalls(0);
+    static std::atomic<uint64_t> stallMicros(0);
+    static std::atomic<uint64_t> prefetchedBytes(0);
+    static std::atomic<uint64_t> prefetchHits(0);
+
+    // Open loaders, for the memory budget to measure and trim.
+    static std::mutex loadersLock;
+    static std::vector<MmapFileLoader *> loaders;
+} // namespace OpenEmuFileLoader
+
+MmapFileLoader::MmapFileLoader(const Path &filename)
+    : filename_(filename), pageSize_((size_t)sysconf(_SC_PAGESIZE)), window_(MIN_WINDOW), prefetchStart_(0), prefetchEnd_(0) {
+    fd_ = open(filename.c_str(), O_RDONLY);
+    if (fd_ < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || st.st_size <= 0)
+        return;
+    size_ = (size_t)st.st_size;
+
+    void *base = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (base == MAP_FAILED) {
+        WARN_LOG(LOADER, "mmap of %s failed: %s", filename.c_str(), strerror(errno));
+        size_ = 0;
+        return;
+    }
+    base_ = (const uint8_t *)base;
+    // The kernel's default readahead stays on, ours only goes further ahead once the
+    // game streams.
+
+    thread_ = std::thread(&MmapFileLoader::ReadAheadThread, this);
+    {
+        std::lock_guard<std::mutex> guard(OpenEmuFileLoader::loadersLock);
+        OpenEmuFileLoader::loaders.push_back(this);
+    }
+    INFO_LOG(LOADER, "Mapped %s (%zu bytes)", filename.c_str(), size_);
+}
+
+MmapFileLoader::~MmapFileLoader() {
+    {
+        std::lock_guard<std::mutex> guard(OpenEmuFileLoader::loadersLock);
+        auto &loaders = OpenEmuFileLoader::loaders;
+        loaders.erase(std::remove(loaders.begin(), loaders.end(), this), loaders.end());
+    }
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            running_ = false;
+        }
+        cond_.notify_one();
+        thread_.join();
+    }
+    if (base_)
+        munmap((void *)base_, size_);
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+bool MmapFileLoader::Exists() {
+    return base_ != nullptr;
+}
+
+bool MmapFileLoader::IsResident(size_t offset, size_t bytes) {
+    size_t first = offset & ~(pageSize_ - 1);
+    size_t last = (offset + bytes + pageSize_ - 1) & ~(pageSize_ - 1);
+    size_t pages = (last - first) / pageSize_;
+
+    // Reads are a sector or a few at a time, this rarely needs more than the stack buffer.
+    MincoreVec small[64];
+    std::vector<MincoreVec> large;
+    MincoreVec *vec = small;
+    if (pages > sizeof(small)) {
+        large.resize(pages);
+        vec = &large[0];
+    }
+
+    if (mincore((void *)(base_ + first), last - first, vec) != 0)
+        return true;
+    for (size_t i = 0; i < pages; i++) {
+        if (!(vec[i] & 1))
+            return false;
+    }
+    return true;
+}
+
+size_t MmapFileLoader::ResidentBytes() {
+    if (!base_)
+        return 0;
+    // A byte per page, a few hundred KB for a full UMD image.
+    size_t pages = (size_ + pageSize_ - 1) / pageSize_;
+    std::vector<MincoreVec> vec(pages);
+    if (mincore((void *)base_, size_, &vec[0]) != 0)
+        return 0;
+    size_t resident = 0;
+    for (size_t i = 0; i < pages; i++)
+        resident += vec[i] & 1;
+    return resident * pageSize_;
+}
+
+void MmapFileLoader::Trim() {
+    if (!base_)
+        return;
+    // Nothing is prefetched anymore, and the next sequential read starts a new window.
+    prefetchStart_.store(0, std::memory_order_release);
+    prefetchEnd_.store(0, std::memory_order_release);
+    madvise((void *)base_, size_, MADV_DONTNEED);
+}
+
+size_t MmapFileLoader::ReadAt(s64 absolutePos, size_t bytes, void *data, Flags flags) {
+    if (!base_ || absolutePos < 0 || (size_t)absolutePos >= size_)
+        return 0;
+
+    size_t offset = (size_t)absolutePos;
+    bytes = std::min(bytes, size_ - offset);
+    size_t end = offset + bytes;
+
+    // Sequential detection, only ever touched from the reading thread.
+    if (offset >= lastEnd_ && offset - lastEnd_ <= pageSize_) {
+        sequentialReads_++;
+    } else {
+        sequentialReads_ = 0;
+        window_ = MIN_WINDOW;
+    }
+    lastEnd_ = end;
+
+    bool streaming = sequentialReads_ >= SEQUENTIAL_THRESHOLD;
+    bool prefetched = offset >= prefetchStart_.load(std::memory_order_acquire) && end <= prefetchEnd_.load(std::memory_order_acquire);
+    if (prefetched) {
+        memcpy(data, base_ + offset, bytes);
+        OpenEmuFileLoader::prefetchHits++;
+    } else if (streaming && !IsResident(offset, bytes)) {
+        // Only worth a mincore while read-ahead is supposed to be keeping up.
+        double start = time_now_d();
+        memcpy(data, base_ + offset, bytes);
+        OpenEmuFileLoader::stalls++;
+        OpenEmuFileLoader::stallMicros += (uint64_t)((time_now_d() - start) * 1e6);
+    } else {
+        memcpy(data, base_ + offset, bytes);
+    }
+
+    if (streaming && end + window_ / 2 > prefetchEnd_.load(std::memory_order_relaxed)) {
+        // Getting close to the end of what's been faulted in, ask for the next window.
+        if (prefetched)
+            window_ = std::min(window_ * 2, MAX_WINDOW);
+        std::lock_guard<std::mutex> guard(lock_);
+        requestStart_ = end;
+        requestEnd_ = std::min(end + window_, size_);
+        cond_.notify_one();
+    }
+
+    OpenEmuFileLoader::reads++;
+    OpenEmuFileLoader::bytesRead += bytes;
+    return bytes;
+}
+
+void MmapFileLoader::ReadAheadThread() {
+    SetCurrentThreadName("ISOReadAhead");
+    // Otherwise it inherits the pinning of whichever thread opened the image.
+    OpenEmuThreadPlacement::PlaceCurrentThread(OpenEmuThreadPlacement::Role::WORKER);
+
+    std::unique_lock<std::mutex> lock(lock_);
+    while (true) {
+        cond_.wait(lock, [this] { return !running_ || requestEnd_ > requestStart_; });
+        if (!running_)
+            break;
+
+        size_t start = requestStart_ & ~(pageSize_ - 1);
+        size_t end = requestEnd_;
+        requestStart_ = requestEnd_ = 0;
+        lock.unlock();
+
+        // Only fault in what isn't already covered, the window keeps sliding forward.
+        size_t done = prefetchEnd_.load(std::memory_order_relaxed);
+        if (start < prefetchStart_.load(std::memory_order_relaxed) || start > done)
+            done = start;
+
+        if (end > done) {
+            madvise((void *)(base_ + (done & ~(pageSize_ - 1))), end - (done & ~(pageSize_ - 1)), MADV_WILLNEED);
+            volatile uint8_t sink = 0;
+            for (size_t pos = done; pos < end; pos += pageSize_)
+                sink += base_[pos];
+            (void)sink;
+
+            // Not atomic as a pair, a reader seeing a stale start only misses a hit.
+            prefetchStart_.store(start, std::memory_order_release);
+            prefetchEnd_.store(end, std::memory_order_release);
+            OpenEmuFileLoader::prefetchedBytes += end - done;
+        }
+
+        lock.lock();
+    }
+}
+
+namespace OpenEmuFileLoader {
+    static size_t ReadHeader(const Path &image, uint8_t *header, size_t size) {
+        FILE *file = fopen(image.c_str(), "rb");
+        if (!file)
+            return 0;
+        size_t read = fread(header, 1, size, file);
+        fclose(file);
+        return read;
+    }
+
+    static bool IsCompressed(const uint8_t *header, size_t size) {
+        return size >= 4 && (!memcmp(header, "CISO", 4) || !memcmp(header, "ZISO", 4) || !memcmp(header, "DAX\0", 4));
+    }
+
+    class ImageLoaderFactory : public FileLoaderFactory {
+    public:
+        explicit ImageLoaderFactory(const Path &image) : image_(image) {}
+
+        FileLoader *ConstructFileLoader(const Path &filename) override {
+            if (filename != image_)
+                return new LocalFileLoader(filename);
+
+            uint8_t header[24] = {};
+            size_t headerSize = ReadHeader(filename, header, sizeof(header));
+            if (OpenEmuCsoLoader::IsSupported(header, headerSize)) {
+                CsoFileLoader *loader = new CsoFileLoader(new LocalFileLoader(filename));
+                if (loader->IsValid())
+                    return loader;
+                delete loader;
+            } else if (!IsCompressed(header, headerSize)) {
+                MmapFileLoader *loader = new MmapFileLoader(filename);
+                if (loader->IsMapped())
+                    return loader;
+                delete loader;
+            }
+            return new LocalFileLoader(filename);
+        }
+
+    private:
+        Path image_;
+    };
+
+    void RegisterForImage(const Path &image) {
+        // Factories are matched by prefix, the factory itself checks for the exact path.
+        RegisterFileLoaderFactory(image.ToString(), std::unique_ptr<FileLoaderFactory>(new ImageLoaderFactory(image)));
+    }
+
+    uint64_t ResidentBytes() {
+        std::lock_guard<std::mutex> guard(loadersLock);
+        uint64_t bytes = 0;
+        for (MmapFileLoader *loader : loaders)
+            bytes += loader->ResidentBytes();
+        return bytes;
+    }
+
+    void Trim() {
+        std::lock_guard<std::mutex> guard(loadersLock);
+        for (MmapFileLoader *loader : loaders)
+            loader->Trim();
+    }
+
+    Stats GetStats() {
+        Stats stats;
+        stats.reads = reads;
+        stats.bytesRead = bytesRead;
+        stats.stalls = stalls;
+        stats.stallMs = stallMicros / 1000.0;
+        stats.prefetchedBytes = prefetchedBytes;
+        stats.prefetchHits = prefetchHits;
+        return stats;
+    }
+} // namespace OpenEmuFileLoader
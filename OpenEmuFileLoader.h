@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Common/File/Path.h"
+#include "Core/Loaders.h"
+
+// Uncompressed images mapped into memory. Reads are a memcpy out of the mapping, and a
+// read-ahead thread watches for sequential access (FMVs, streamed level data) and
+// faults in the pages ahead of it, so the emu thread finds them resident instead of
+// blocking on the disk.
+class MmapFileLoader : public FileLoader {
+public:
+    explicit MmapFileLoader(const Path &filename);
+    ~MmapFileLoader();
+
+    bool Exists() override;
+    bool IsDirectory() override { return false; }
+    s64 FileSize() override { return size_; }
+    Path GetPath() const override { return filename_; }
+    size_t ReadAt(s64 absolutePos, size_t bytes, void *data, Flags flags = Flags::NONE) override;
+
+    bool IsMapped() const { return base_ != nullptr; }
+
+    // Mapped pages in the page cache. An upper bound on what the mapping adds to RSS, pages
+    // another process faulted in count too.
+    size_t ResidentBytes();
+    // Drops the mapping's pages from our RSS, they fault back in from the file when read.
+    void Trim();
+
+private:
+    bool IsResident(size_t offset, size_t bytes);
+    void ReadAheadThread();
+
+    Path filename_;
+    int fd_ = -1;
+    const uint8_t *base_ = nullptr;
+    size_t size_ = 0;
+    size_t pageSize_;
+
+    // Emu thread side of the sequential detector.
+    size_t lastEnd_ = 0;
+    int sequentialReads_ = 0;
+    size_t window_;
+
+    // [prefetchStart_, prefetchEnd_) is what the read-ahead thread already touched.
+    std::atomic<size_t> prefetchStart_;
+    std::atomic<size_t> prefetchEnd_;
+
+    std::mutex lock_;
+    std::condition_variable cond_;
+    size_t requestStart_ = 0;
+    size_t requestEnd_ = 0;
+    bool running_ = true;
+    std::thread thread_;
+};
+
+namespace OpenEmuFileLoader {
+    struct Stats {
+        uint64_t reads;
+        uint64_t bytesRead;
+        // Sequential reads that read-ahead didn't cover and touched pages which weren't
+        // resident yet, and the time they took. Random reads aren't checked.
+        uint64_t stalls;
+        double stallMs;
+        uint64_t prefetchedBytes;
+        // Reads fully inside the range the read-ahead thread already faulted in.
+        uint64_t prefetchHits;
+    };
+
+    // Makes PPSSPP open `image` through MmapFileLoader when it's an uncompressed image, or
+    // CsoFileLoader when it's a CSO that loader handles. Anything else, and every other
+    // path, still gets the stock loader.
+    void RegisterForImage(const Path &image);
+
+    // Any thread. Over every MmapFileLoader currently open.
+    uint64_t ResidentBytes();
+    void Trim();
+
+    Stats GetStats();
+} // namespace OpenEmuFileLoader
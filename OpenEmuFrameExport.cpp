@@ -0,0 +1,263 @@
+#include "OpenEmuFrameExport.h"
+
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include "Common/GPU/OpenGL/GLCommon.h"
+#else
+// The headless tool on a Mesa stack, see BenchmarkFrameExport.
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+#include "Common/Log.h"
+#include "Common/TimeUtil.h"
+
+namespace OpenEmuFrameExport {
+    // Three frames of latency is about what the GPU can be behind by with inflight frames.
+    static const int NUM_PBOS = 3;
+
+    struct Readback {
+        GLuint pbo;
+        GLsync fence;
+        uint64_t frame;
+        double timestamp;
+    };
+
+    // Written by Configure, picked up by the host thread.
+    static std::mutex configLock;
+    static std::string pendingName;
+    static int pendingWidth = 0;
+    static int pendingHeight = 0;
+    static int pendingSlots = 0;
+    static std::atomic<bool> configChanged(false);
+    static std::atomic<bool> configured(false);
+
+    // Host thread only.
+    static std::string shmName;
+    static uint8_t *shared = nullptr;
+    static size_t sharedBytes = 0;
+    static int width = 0;
+    static int height = 0;
+    static Readback readbacks[NUM_PBOS];
+    static bool pbosCreated = false;
+    // Oldest readback still in flight, and how many there are.
+    static int head = 0;
+    static int inFlight = 0;
+    static uint64_t frameCounter = 0;
+
+    static std::mutex statsLock;
+    static Stats stats;
+
+    static SharedHeader *Header() {
+        return (SharedHeader *)shared;
+    }
+
+    static void Release() {
+        if (pbosCreated) {
+            for (Readback &readback : readbacks) {
+                if (readback.fence)
+                    glDeleteSync(readback.fence);
+                readback.fence = nullptr;
+            }
+            GLuint pbos[NUM_PBOS];
+            for (int i = 0; i < NUM_PBOS; i++)
+                pbos[i] = readbacks[i].pbo;
+            glDeleteBuffers(NUM_PBOS, pbos);
+            pbosCreated = false;
+        }
+        head = 0;
+        inFlight = 0;
+
+        if (shared) {
+            munmap(shared, sharedBytes);
+            shm_unlink(shmName.c_str());
+            shared = nullptr;
+        }
+    }
+
+    static bool Create(const std::string &name, int w, int h, int slots) {
+        uint32_t stride = (uint32_t)w * 4;
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        // Page aligned slots and pixel data, so a reader can map or DMA straight from them.
+        size_t slotOffset = (sizeof(SharedHeader) + page - 1) & ~(page - 1);
+        size_t pixelOffset = (sizeof(SlotHeader) + 63) & ~(size_t)63;
+        size_t slotBytes = (pixelOffset + (size_t)stride * h + page - 1) & ~(page - 1);
+        size_t total = slotOffset + slotBytes * slots;
+
+        // A stale object from a crashed run would have the wrong size.
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) {
+            ERROR_LOG(G3D, "Frame export: shm_open(%s) failed: %s", name.c_str(), strerror(errno));
+            return false;
+        }
+        if (ftruncate(fd, (off_t)total) != 0) {
+            ERROR_LOG(G3D, "Frame export: can't size %s to %zu bytes", name.c_str(), total);
+            close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        void *mapped = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            return false;
+        }
+
+        shmName = name;
+        shared = (uint8_t *)mapped;
+        sharedBytes = total;
+        width = w;
+        height = h;
+
+        SharedHeader *header = Header();
+        header->version = SHARED_VERSION;
+        header->width = w;
+        header->height = h;
+        header->stride = stride;
+        header->format = 0;
+        header->slotCount = slots;
+        header->slotOffset = (uint32_t)slotOffset;
+        header->slotBytes = (uint32_t)slotBytes;
+        header->pixelOffset = (uint32_t)pixelOffset;
+        header->published.store(0, std::memory_order_relaxed);
+        header->dropped.store(0, std::memory_order_relaxed);
+        // Magic last, a reader polling for it sees a complete header.
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(header->magic, "OEFX", 4);
+
+        GLuint pbos[NUM_PBOS];
+        glGenBuffers(NUM_PBOS, pbos);
+        for (int i = 0; i < NUM_PBOS; i++) {
+            readbacks[i].pbo = pbos[i];
+            readbacks[i].fence = nullptr;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)stride * h, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pbosCreated = true;
+
+        frameCounter = 0;
+        INFO_LOG(G3D, "Frame export: %dx%d into %s, %d slots", w, h, name.c_str(), slots);
+        return true;
+    }
+
+    static void Publish(Readback &readback) {
+        SharedHeader *header = Header();
+        uint64_t index = header->published.load(std::memory_order_relaxed);
+        uint8_t *slot = shared + header->slotOffset + (size_t)(index % header->slotCount) * header->slotBytes;
+        SlotHeader *slotHeader = (SlotHeader *)slot;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+        size_t bytes = (size_t)header->stride * height;
+        const void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)bytes, GL_MAP_READ_BIT);
+        if (pixels) {
+            uint32_t seq = slotHeader->seq.load(std::memory_order_relaxed);
+            slotHeader->seq.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slotHeader->frame = readback.frame;
+            slotHeader->timestamp = readback.timestamp;
+            memcpy(slot + header->pixelOffset, pixels, bytes);
+            slotHeader->seq.store(seq + 2, std::memory_order_release);
+            header->published.store(index + 1, std::memory_order_release);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+            std::lock_guard<std::mutex> guard(statsLock);
+            stats.published++;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    static void CollectFinished() {
+        // In order, so frames are published in the order they were presented.
+        while (inFlight > 0) {
+            Readback &readback = readbacks[head];
+            GLenum result = glClientWaitSync(readback.fence, 0, 0);
+            if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+                break;
+            glDeleteSync(readback.fence);
+            readback.fence = nullptr;
+            Publish(readback);
+            head = (head + 1) % NUM_PBOS;
+            inFlight--;
+        }
+    }
+
+    void Configure(const std::string &name, int w, int h, int slots) {
+        std::lock_guard<std::mutex> guard(configLock);
+        pendingName = name;
+        pendingWidth = w;
+        pendingHeight = h;
+        pendingSlots = slots;
+        configChanged = true;
+        configured = !name.empty() && w > 0 && h > 0 && slots > 0;
+    }
+
+    bool IsConfigured() {
+        return configured;
+    }
+
+    void CaptureFrame(unsigned int fbo) {
+        if (configChanged.exchange(false)) {
+            Release();
+            std::lock_guard<std::mutex> guard(configLock);
+            if (configured && !Create(pendingName, pendingWidth, pendingHeight, pendingSlots))
+                configured = false;
+        }
+        if (!shared)
+            return;
+
+        double start = time_now_d();
+        CollectFinished();
+
+        bool dropped = inFlight == NUM_PBOS;
+        if (!dropped) {
+            Readback &readback = readbacks[(head + inFlight) % NUM_PBOS];
+            readback.frame = frameCounter;
+            readback.timestamp = start;
+
+            GLint previousRead = 0;
+            glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            // Into the PBO, this returns as soon as the copy is queued.
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, previousRead);
+            inFlight++;
+        } else {
+            Header()->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        frameCounter++;
+
+        double ms = (time_now_d() - start) * 1000.0;
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.presented++;
+        if (dropped)
+            stats.dropped++;
+        stats.captureMs += ms;
+        if (ms > stats.maxCaptureMs)
+            stats.maxCaptureMs = ms;
+    }
+
+    void Shutdown() {
+        // Whatever already finished still goes out.
+        if (shared)
+            CollectFinished();
+        Release();
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(statsLock);
+        return stats;
+    }
+} // namespace OpenEmuFrameExport
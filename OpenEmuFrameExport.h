@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Copies every presented frame out of the host FBO for capture tools, without stalling
+// the render pipeline. Readbacks go into a ring of pixel buffer objects, each fenced, and
+// are only mapped once their fence has signalled, a few frames later. If every PBO is
+// still in flight the frame is dropped rather than waited for.
+//
+// Finished frames land in a POSIX shared memory ring that another process (an encoder,
+// a visual diff) maps read-only and reads in place. The writer never waits for readers:
+// a reader that falls more than a ring behind sees the frame numbers jump.
+namespace OpenEmuFrameExport {
+    static const uint32_t SHARED_VERSION = 1;
+
+    // Start of the shared memory object. Slots follow at slotOffset, slotBytes apart.
+    struct SharedHeader {
+        char magic[4];  // "OEFX"
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;  // Bytes per row.
+        uint32_t format;  // 0: RGBA8, rows bottom to top like GL.
+        uint32_t slotCount;
+        uint32_t slotOffset;
+        uint32_t slotBytes;
+        uint32_t pixelOffset;  // From the start of a slot.
+        // Frames published so far, the newest is in slot (published - 1) % slotCount.
+        std::atomic<uint64_t> published;
+        // Frames the writer had to skip, see Stats.
+        std::atomic<uint64_t> dropped;
+    };
+
+    struct SlotHeader {
+        // Odd while the slot is being written. Readers check it is even and unchanged
+        // around their read.
+        std::atomic<uint32_t> seq;
+        uint32_t reserved;
+        uint64_t frame;    // Present count since Configure.
+        double timestamp;  // time_now_d() when the frame was presented.
+    };
+
+    struct Stats {
+        uint64_t presented;
+        uint64_t published;
+        // No free PBO, the GPU hadn't finished the readbacks of earlier frames yet.
+        uint64_t dropped;
+        // Host thread time spent in CaptureFrame, issuing readbacks and copying finished
+        // ones out.
+        double captureMs;
+        double maxCaptureMs;
+    };
+
+    // Any thread, takes effect on the next CaptureFrame. name is a shm_open name like
+    // "/ppsspp-frames". width and height are the size of the FBO being captured.
+    void Configure(const std::string &name, int width, int height, int slots = 8);
+    bool IsConfigured();
+
+    // Host thread, with the GL context current, right after the frame was drawn into fbo.
+    void CaptureFrame(unsigned int fbo);
+
+    // Host thread. Frees the GL objects and removes the shared memory object.
+    void Shutdown();
+
+    Stats GetStats();
+} // namespace OpenEmuFrameExport
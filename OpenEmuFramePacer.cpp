@@ -0,0 +1,129 @@
+#include "OpenEmuFramePacer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "Common/TimeUtil.h"
+#include "Core/System.h"
+
+#include "OpenEmuFastForward.h"
+
+namespace OpenEmuFramePacer {
+    // Sleeps overshoot by up to a millisecond or so on a busy system, the last stretch
+    // before a deadline gets spun instead.
+    static const double SPIN_WINDOW = 0.0015;
+
+    static std::atomic<bool> enabled(true);
+    static std::atomic<double> interval(1.0 / 59.94);
+    static std::atomic<bool> resyncRequested(true);
+
+    // Emu thread only.
+    static double nextDeadline = 0.0;
+    static double lastStart = 0.0;
+    static double frameStart = 0.0;
+    static bool paced = false;
+
+    static std::mutex statsLock;
+    static Stats stats;
+
+    void SetEnabled(bool enable) {
+        enabled = enable;
+        resyncRequested = true;
+    }
+
+    bool IsEnabled() {
+        return enabled;
+    }
+
+    void SetFrameRate(double hz) {
+        if (hz > 0.0)
+            interval = 1.0 / hz;
+        resyncRequested = true;
+    }
+
+    void Resync() {
+        resyncRequested = true;
+    }
+
+    static void WaitUntil(double deadline) {
+        double now = time_now_d();
+        if (deadline - now > SPIN_WINDOW)
+            std::this_thread::sleep_for(std::chrono::duration<double>(deadline - now - SPIN_WINDOW));
+        while (time_now_d() < deadline)
+            std::this_thread::yield();
+    }
+
+    void BeginFrame() {
+        // Fixed multiples of fast-forward are still paced, they just do more per frame.
+        paced = enabled && !PSP_CoreParameter().fastForward && !OpenEmuFastForward::IsUnbounded();
+        if (!paced) {
+            resyncRequested = true;
+            return;
+        }
+
+        double frameInterval = interval;
+        double now = time_now_d();
+        bool resync = resyncRequested.exchange(false);
+        if (!resync && now - nextDeadline > frameInterval) {
+            // More than a whole frame behind, catching up would only produce a burst.
+            resync = true;
+            std::lock_guard<std::mutex> guard(statsLock);
+            stats.resyncs++;
+        }
+        if (resync) {
+            nextDeadline = now;
+            lastStart = 0.0;
+        }
+
+        WaitUntil(nextDeadline);
+        double start = time_now_d();
+        double late = start - nextDeadline;
+        nextDeadline += frameInterval;
+        frameStart = start;
+
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.startJitter.Add(late * 1000.0);
+        if (late > frameInterval * 0.5)
+            stats.lateFrames++;
+        if (lastStart != 0.0)
+            stats.frameInterval.Add((start - lastStart) * 1000.0);
+        lastStart = start;
+    }
+
+    void EndFrame() {
+        if (!paced)
+            return;
+        double end = time_now_d();
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.emuTime.Add((end - frameStart) * 1000.0);
+    }
+
+    double TimeUntilNextFrame() {
+        if (!enabled || PSP_CoreParameter().fastForward || OpenEmuFastForward::IsUnbounded() || resyncRequested)
+            return 0.0;
+        return std::max(0.0, nextDeadline - time_now_d());
+    }
+
+    void RecordPresent(double ms) {
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.presentTime.Add(ms);
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(statsLock);
+        return stats;
+    }
+
+    void ResetStats() {
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.startJitter.Reset();
+        stats.frameInterval.Reset();
+        stats.emuTime.Reset();
+        stats.presentTime.Reset();
+        stats.lateFrames = 0;
+        stats.resyncs = 0;
+    }
+} // namespace OpenEmuFramePacer
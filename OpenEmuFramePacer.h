@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include "FrameStats.h"
+
+// Schedules emu frames against fixed deadlines instead of letting the emu thread run as
+// soon as the host hands it a frame. Each frame gets a deadline one frame interval after
+// the previous one; the emu thread sleeps until shortly before it and spins the rest of
+// the way, so frames start on a steady cadence rather than in occasional bursts of two.
+//
+// Falling more than a frame behind re-anchors the schedule at the current time instead
+// of running frames back to back to catch up. Unbounded fast-forward bypasses the pacer.
+namespace OpenEmuFramePacer {
+    struct Stats {
+        // How late each frame started relative to its deadline.
+        FrameTimeHistogram startJitter;
+        // Start of one frame to the start of the next.
+        FrameTimeHistogram frameInterval;
+        // Time spent in EmuFrame once the frame started.
+        FrameTimeHistogram emuTime;
+        // Host side ThreadFrame + SwapBuffers.
+        FrameTimeHistogram presentTime;
+        uint64_t lateFrames;  // Started more than half a frame after the deadline.
+        uint64_t resyncs;
+    };
+
+    void SetEnabled(bool enabled);
+    bool IsEnabled();
+    void SetFrameRate(double hz);
+
+    // Forget the schedule, e.g. after the emu thread was paused. The next frame starts
+    // right away and anchors a new one.
+    void Resync();
+
+    // Emu thread, around EmuFrame.
+    void BeginFrame();
+    void EndFrame();
+    // Emu thread, before BeginFrame. Seconds BeginFrame would sleep, 0 when not pacing.
+    double TimeUntilNextFrame();
+
+    // Host thread, after presenting.
+    void RecordPresent(double ms);
+
+    Stats GetStats();
+    void ResetStats();
+} // namespace OpenEmuFramePacer
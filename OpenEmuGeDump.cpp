@@ -0,0 +1,74 @@
+#include "OpenEmuGeDump.h"
+
+#include <cstdio>
+#include <mutex>
+
+#include "Common/File/FileUtil.h"
+#include "Common/Log.h"
+#include "Core/ELF/ParamSFO.h"
+#include "GPU/Debugger/Record.h"
+
+namespace OpenEmuGeDump {
+    static std::mutex lock;
+    static Path directory;
+    // Frames still to record, counting the one GPURecord is armed for.
+    static int remaining = 0;
+    static bool armed = false;
+    static int sequence = 0;
+    static Stats stats;
+
+    void Start(const Path &dumpDirectory, int frames) {
+        std::lock_guard<std::mutex> guard(lock);
+        directory = dumpDirectory;
+        remaining = frames > 0 ? frames : 0;
+        sequence = 0;
+        stats = Stats();
+    }
+
+    bool IsRecording() {
+        std::lock_guard<std::mutex> guard(lock);
+        return remaining > 0;
+    }
+
+    // Emu thread, from the flip that finished the recording.
+    static void OnDumpWritten(const Path &written) {
+        std::lock_guard<std::mutex> guard(lock);
+        armed = false;
+        if (remaining == 0)
+            return;
+        remaining--;
+
+        char name[64];
+        std::string discID = g_paramSFO.GetDiscID();
+        snprintf(name, sizeof(name), "%s_%04d.ppdmp", discID.empty() ? "dump" : discID.c_str(), sequence++);
+        Path target = directory / name;
+        File::CreateFullPath(directory);
+        if (!File::Rename(written, target)) {
+            WARN_LOG(G3D, "Can't move %s to %s", written.c_str(), target.c_str());
+            target = written;
+        }
+
+        stats.recorded++;
+        stats.bytes += File::GetFileSize(target);
+        stats.files.push_back(target.ToString());
+        INFO_LOG(G3D, "GE dump %s, %d left", target.c_str(), remaining);
+    }
+
+    void OnFrameBoundary() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (remaining == 0 || armed)
+            return;
+        // False while a recording is still pending or running.
+        if (!GPURecord::Activate())
+            return;
+        armed = true;
+        GPURecord::SetCallback([](const Path &written) {
+            OnDumpWritten(written);
+        });
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats;
+    }
+} // namespace OpenEmuGeDump
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Common/File/Path.h"
+
+// Records GE frame dumps from a running game, for benchmarking the GPU path without the
+// game or the CPU core. Each dump is PPSSPP's own .ppdmp (GPURecord): one frame's display
+// lists, with the memory and textures they reference. Booting a dump as the image replays
+// that frame in a loop, see --gl in Headless/HeadlessMain.cpp.
+//
+// GPURecord takes one frame per activation and needs a few flips between activations, so
+// a recording of several frames samples about every sixth frame rather than a continuous
+// stretch.
+namespace OpenEmuGeDump {
+    struct Stats {
+        uint64_t recorded;
+        uint64_t bytes;
+        // Paths of the dumps, in the order they were taken.
+        std::vector<std::string> files;
+    };
+
+    // Records the next `frames` frames into directory as <discID>_<n>.ppdmp. Any thread,
+    // starts at the emu thread's next frame boundary.
+    void Start(const Path &directory, int frames);
+    bool IsRecording();
+
+    // Emu thread, between frames. Arms GPURecord for another frame while some are left.
+    void OnFrameBoundary();
+
+    Stats GetStats();
+} // namespace OpenEmuGeDump
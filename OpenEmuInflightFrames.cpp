@@ -0,0 +1,190 @@
+#include "OpenEmuInflightFrames.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "Common/Log.h"
+#include "Common/TimeUtil.h"
+
+#include "OpenEmuFastForward.h"
+
+namespace OpenEmuInflightFrames {
+    static const double FRAME_MS = 1000.0 / 59.94;
+    // A present this long left no room for the swap, the host missed its vsync.
+    static const double MISS_MS = FRAME_MS * 0.8;
+
+    // This many misses within RAISE_WINDOW frames raise the depth. One alone is usually a
+    // hitch no depth would have hidden, like a shader compile.
+    static const uint32_t RAISE_MISSES = 2;
+    static const uint64_t RAISE_WINDOW = 60;
+
+    // Frames without a miss before trying one frame less, doubled each time that fails.
+    static const uint64_t LOWER_AFTER = 600;
+    static const uint64_t MAX_LOWER_AFTER = 600 * 16;
+    // A raise this soon after lowering means the lower depth didn't hold.
+    static const uint64_t PROBE_FRAMES = 1200;
+
+    static const size_t MAX_DECISIONS = 64;
+    // Submitted frames waiting for their present, more than GLRenderManager ever queues.
+    static const int MAX_PENDING = 8;
+
+    static std::atomic<bool> enabled(true);
+    static std::atomic<int> resetDepth(0);
+
+    static std::mutex lock;
+    static Stats stats;
+    // Start times of submitted frames, consumed by the host in order.
+    static double pending[MAX_PENDING];
+    static int pendingHead = 0;
+    static int pendingCount = 0;
+    // Since the last decision.
+    static uint32_t missesSinceDecision = 0;
+    static double latencySinceDecision = 0.0;
+    static uint32_t latencyCount = 0;
+    // Host misses not yet seen by the emu thread.
+    static uint32_t newMisses = 0;
+
+    // Emu thread only.
+    static int depth = 0;
+    static uint64_t frame = 0;
+    // Last decision or miss, whichever came later.
+    static uint64_t stableSince = 0;
+    static uint64_t lastLower = 0;
+    static uint64_t lowerAfter = LOWER_AFTER;
+    static uint64_t windowStart = 0;
+    static uint32_t windowMisses = 0;
+    static double frameStart = 0.0;
+
+    void SetEnabled(bool enable) {
+        enabled = enable;
+    }
+
+    bool IsEnabled() {
+        return enabled;
+    }
+
+    void Reset(int startDepth) {
+        resetDepth = std::min(std::max(startDepth, MIN_DEPTH), MAX_DEPTH);
+    }
+
+    // Under lock.
+    static void Decide(int to, const char *reason) {
+        Decision decision;
+        decision.frame = frame;
+        decision.from = depth;
+        decision.to = to;
+        decision.reason = reason;
+        decision.misses = missesSinceDecision;
+        decision.latencyMs = latencyCount ? latencySinceDecision / latencyCount : 0.0;
+        if (stats.decisions.size() == MAX_DECISIONS)
+            stats.decisions.erase(stats.decisions.begin());
+        stats.decisions.push_back(decision);
+        missesSinceDecision = 0;
+        latencySinceDecision = 0.0;
+        latencyCount = 0;
+
+        // NOTICE, Release builds compile INFO out.
+        NOTICE_LOG(G3D, "In-flight frames %d -> %d at frame %llu (%s, %u misses, %.1f ms latency)", decision.from, to,
+            (unsigned long long)frame, reason, decision.misses, decision.latencyMs);
+        depth = to;
+        stableSince = frame;
+        stats.depth = to;
+    }
+
+    int BeginFrame() {
+        frameStart = time_now_d();
+        frame++;
+
+        std::lock_guard<std::mutex> guard(lock);
+        int reset = resetDepth.exchange(0);
+        if (reset != 0) {
+            Decide(reset, "reset");
+            lastLower = 0;
+            lowerAfter = LOWER_AFTER;
+            windowStart = frame;
+            windowMisses = 0;
+            newMisses = 0;
+            pendingCount = 0;
+            return depth;
+        }
+
+        uint32_t misses = newMisses;
+        newMisses = 0;
+        // Unbounded fast-forward outruns the host by design, that says nothing about depth.
+        if (depth == 0 || !enabled || OpenEmuFastForward::IsUnbounded())
+            return 0;
+
+        if (frame - windowStart >= RAISE_WINDOW) {
+            windowStart = frame;
+            windowMisses = 0;
+        }
+        windowMisses += misses;
+
+        if (windowMisses >= RAISE_MISSES && depth < MAX_DEPTH) {
+            if (lastLower != 0 && frame - lastLower < PROBE_FRAMES)
+                lowerAfter = std::min(lowerAfter * 2, MAX_LOWER_AFTER);
+            Decide(depth + 1, "missed presents");
+            windowStart = frame;
+            windowMisses = 0;
+            return depth;
+        }
+        if (misses > 0) {
+            // Any miss restarts the wait before lowering.
+            stableSince = frame;
+        } else if (depth > MIN_DEPTH && frame - stableSince >= lowerAfter) {
+            Decide(depth - 1, "stable");
+            lastLower = frame;
+            return depth;
+        }
+        return 0;
+    }
+
+    void EndFrame() {
+        double end = time_now_d();
+        std::lock_guard<std::mutex> guard(lock);
+        stats.submitTime.Add((end - frameStart) * 1000.0);
+        if (pendingCount == MAX_PENDING) {
+            // Nothing is presenting, e.g. headless.
+            pendingHead = (pendingHead + 1) % MAX_PENDING;
+            pendingCount--;
+        }
+        pending[(pendingHead + pendingCount) % MAX_PENDING] = frameStart;
+        pendingCount++;
+    }
+
+    void RecordPresent(double ms) {
+        double now = time_now_d();
+        std::lock_guard<std::mutex> guard(lock);
+        if (stats.depth == 0)
+            return;
+
+        int current = stats.depth;
+        stats.frames++;
+        stats.framesAtDepth[current]++;
+        stats.presentTime.Add(ms);
+        if (ms > MISS_MS) {
+            stats.misses++;
+            stats.missesAtDepth[current]++;
+            missesSinceDecision++;
+            newMisses++;
+        }
+
+        if (pendingCount > 0) {
+            double latency = (now - pending[pendingHead]) * 1000.0;
+            pendingHead = (pendingHead + 1) % MAX_PENDING;
+            pendingCount--;
+            stats.latency.Add(latency);
+            // Running mean per depth, framesAtDepth is close enough as the count.
+            double &mean = stats.meanLatencyMsAtDepth[current];
+            mean += (latency - mean) / (double)stats.framesAtDepth[current];
+            latencySinceDecision += latency;
+            latencyCount++;
+        }
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats;
+    }
+} // namespace OpenEmuInflightFrames
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FrameStats.h"
+
+// Picks how many frames GLRenderManager lets the emu thread run ahead of the host, per
+// title and at runtime, instead of the static g_Config.iInflightFrames.
+//
+// Every frame in flight is a frame of input latency, so it starts from the configured
+// depth and steps down while presents keep making their slot. A present that takes most
+// of a frame means the host waited for the emu thread or for GL and missed vsync; a few
+// of those in a short window step the depth back up. A lower depth that failed is only
+// retried after twice as long, so a title settles on the lowest depth it can sustain.
+namespace OpenEmuInflightFrames {
+    // GLRenderManager's range.
+    static const int MIN_DEPTH = 1;
+    static const int MAX_DEPTH = 3;
+
+    struct Decision {
+        uint64_t frame;
+        int from;
+        int to;
+        const char *reason;
+        // Missed presents and mean submit-to-present latency since the previous decision.
+        uint32_t misses;
+        double latencyMs;
+    };
+
+    struct Stats {
+        int depth;
+        uint64_t frames;
+        uint64_t misses;
+        uint64_t framesAtDepth[MAX_DEPTH + 1];
+        uint64_t missesAtDepth[MAX_DEPTH + 1];
+        double meanLatencyMsAtDepth[MAX_DEPTH + 1];
+        // Start of the emu frame to the end of the host present that showed it.
+        FrameTimeHistogram latency;
+        // Emu thread, draw->BeginFrame to draw->EndFrame.
+        FrameTimeHistogram submitTime;
+        // Host thread, ThreadFrame and everything else up to the swap.
+        FrameTimeHistogram presentTime;
+        // The most recent decisions, oldest first.
+        std::vector<Decision> decisions;
+    };
+
+    // Disabled, the depth stays wherever it was last set.
+    void SetEnabled(bool enabled);
+    bool IsEnabled();
+
+    // At game start: begin again from depth (usually g_Config.iInflightFrames) and forget
+    // what was learned about the previous title.
+    void Reset(int depth);
+
+    // Emu thread, before draw->BeginFrame. Returns the depth to hand to the render manager,
+    // or 0 if it hasn't changed.
+    int BeginFrame();
+    // Emu thread, after draw->EndFrame.
+    void EndFrame();
+
+    // Host thread, after presenting.
+    void RecordPresent(double ms);
+
+    Stats GetStats();
+} // namespace OpenEmuInflightFrames
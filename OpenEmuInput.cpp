@@ -0,0 +1,202 @@
+#include "OpenEmuInput.h"
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "Common/TimeUtil.h"
+#include "Core/HLE/sceCtrl.h"
+
+InputEventQueue::InputEventQueue() : enqueuePos_(0), dequeuePos_(0) {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+    for (uint32_t i = 0; i < CAPACITY; i++)
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool InputEventQueue::Push(const InputEvent &event) {
+    uint32_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+        cell = &cells_[pos & MASK];
+        uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(sequence - pos);
+        if (diff == 0) {
+            // The cell is free for this position, claim it.
+            if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // Still holds an event from a lap ago.
+            return false;
+        } else {
+            pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->event = event;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool InputEventQueue::Pop(InputEvent *event) {
+    Cell *cell = &cells_[dequeuePos_ & MASK];
+    uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+    if ((int32_t)(sequence - (dequeuePos_ + 1)) < 0)
+        return false;
+
+    *event = cell->event;
+    cell->sequence.store(dequeuePos_ + CAPACITY, std::memory_order_release);
+    dequeuePos_++;
+    return true;
+}
+
+namespace OpenEmuInput {
+    // More than this many frames between the emu thread and presentation means nobody is
+    // presenting them, stop tracking the old ones.
+    static const size_t MAX_UNPRESENTED_FRAMES = 16;
+
+    static InputEventQueue queue;
+    static std::atomic<uint64_t> dropped(0);
+
+    // Emu thread only.
+    // A release of a button pressed earlier in the same frame, held over to the next
+    // frame so the game sees the tap.
+    static InputEvent heldOver;
+    static bool hasHeldOver = false;
+    static float analogX = 0.0f;
+    static float analogY = 0.0f;
+    static std::vector<double> frameTimestamps;
+
+    // Timestamps of the events each not yet presented frame applied, oldest frame first.
+    static std::mutex presentLock;
+    static std::deque<std::vector<double>> unpresented;
+
+    static std::mutex statsLock;
+    static Stats stats;
+
+    static void Push(const InputEvent &event) {
+        if (!queue.Push(event))
+            dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void PushButton(uint32_t ctrlButtons, bool down) {
+        InputEvent event;
+        event.type = down ? InputEvent::Type::BUTTON_DOWN : InputEvent::Type::BUTTON_UP;
+        event.buttons = ctrlButtons;
+        event.value = 0.0f;
+        event.timestamp = time_now_d();
+        Push(event);
+    }
+
+    void PushAnalog(int axis, float value) {
+        InputEvent event;
+        event.type = axis == 0 ? InputEvent::Type::ANALOG_X : InputEvent::Type::ANALOG_Y;
+        event.buttons = 0;
+        event.value = value;
+        event.timestamp = time_now_d();
+        Push(event);
+    }
+
+    void ApplyPending() {
+        InputEvent event;
+        bool analogChanged = false;
+        double now = -1.0;
+        // Buttons that went down this frame.
+        uint32_t pressed = 0;
+
+        while (true) {
+            if (hasHeldOver) {
+                event = heldOver;
+                hasHeldOver = false;
+            } else if (!queue.Pop(&event)) {
+                break;
+            }
+
+            // Releasing in the same frame would cancel the press before the game samples
+            // it. Everything after stays queued so the order holds.
+            if (event.type == InputEvent::Type::BUTTON_UP && (event.buttons & pressed) != 0) {
+                heldOver = event;
+                hasHeldOver = true;
+                break;
+            }
+
+            switch (event.type) {
+                case InputEvent::Type::BUTTON_DOWN:
+                    __CtrlButtonDown(event.buttons);
+                    pressed |= event.buttons;
+                    break;
+                case InputEvent::Type::BUTTON_UP:
+                    __CtrlButtonUp(event.buttons);
+                    break;
+                case InputEvent::Type::ANALOG_X:
+                    analogX = event.value;
+                    analogChanged = true;
+                    break;
+                case InputEvent::Type::ANALOG_Y:
+                    analogY = event.value;
+                    analogChanged = true;
+                    break;
+            }
+
+            if (now < 0.0)
+                now = time_now_d();
+            frameTimestamps.push_back(event.timestamp);
+        }
+
+        if (analogChanged)
+            __CtrlSetAnalogXY(0, analogX, analogY);
+
+        if (!frameTimestamps.empty()) {
+            std::lock_guard<std::mutex> guard(statsLock);
+            for (double timestamp : frameTimestamps)
+                stats.inputToSample.Add((now - timestamp) * 1000.0);
+            stats.events += frameTimestamps.size();
+        }
+    }
+
+    void EndFrame(bool presents) {
+        if (!presents) {
+            frameTimestamps.clear();
+            return;
+        }
+
+        // Every frame gets an entry, even without input, so presents line up with frames.
+        std::lock_guard<std::mutex> guard(presentLock);
+        unpresented.emplace_back();
+        unpresented.back().swap(frameTimestamps);
+        while (unpresented.size() > MAX_UNPRESENTED_FRAMES)
+            unpresented.pop_front();
+    }
+
+    void OnFramePresented() {
+        std::vector<double> timestamps;
+        {
+            std::lock_guard<std::mutex> guard(presentLock);
+            if (unpresented.empty())
+                return;
+            timestamps.swap(unpresented.front());
+            unpresented.pop_front();
+        }
+        if (timestamps.empty())
+            return;
+
+        double now = time_now_d();
+        std::lock_guard<std::mutex> guard(statsLock);
+        for (double timestamp : timestamps)
+            stats.inputToPresent.Add((now - timestamp) * 1000.0);
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(statsLock);
+        Stats result = stats;
+        result.dropped = dropped;
+        return result;
+    }
+
+    void ResetStats() {
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.inputToSample.Reset();
+        stats.inputToPresent.Reset();
+        stats.events = 0;
+        dropped = 0;
+    }
+} // namespace OpenEmuInput
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "FrameStats.h"
+
+struct InputEvent {
+    enum class Type : uint8_t {
+        BUTTON_DOWN,
+        BUTTON_UP,
+        ANALOG_X,
+        ANALOG_Y,
+    };
+
+    Type type;
+    uint32_t buttons;  // CTRL_* mask for button events.
+    float value;       // -1..1 for analog events.
+    double timestamp;  // time_now_d() when the host received it.
+};
+
+// Bounded lock-free multi producer / single consumer queue of input events. Any host thread
+// pushes, the emu thread pops. Each cell carries a sequence number that tells producers and
+// the consumer whose turn it is, so neither side ever waits on the other.
+class InputEventQueue {
+public:
+    static const uint32_t CAPACITY = 1024;
+
+    InputEventQueue();
+
+    // Returns false if the queue is full.
+    bool Push(const InputEvent &event);
+    // Consumer only.
+    bool Pop(InputEvent *event);
+
+private:
+    static const uint32_t MASK = CAPACITY - 1;
+
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        InputEvent event;
+    };
+
+    Cell cells_[CAPACITY];
+    alignas(64) std::atomic<uint32_t> enqueuePos_;
+    alignas(64) uint32_t dequeuePos_;
+};
+
+// Input from the host gets queued with a timestamp and applied by the emu thread between
+// emulated frames, instead of poking sceCtrl from the host thread mid-frame.
+namespace OpenEmuInput {
+    struct Stats {
+        // Host timestamp to the frame boundary that applied the event.
+        FrameTimeHistogram inputToSample;
+        // Host timestamp to SwapBuffers of the first frame that saw the event.
+        FrameTimeHistogram inputToPresent;
+        uint64_t events;
+        uint64_t dropped;
+    };
+
+    // Host side, any thread.
+    void PushButton(uint32_t ctrlButtons, bool down);
+    // axis 0 is X, 1 is Y.
+    void PushAnalog(int axis, float value);
+
+    // Emu thread, at the frame boundary. Applies everything queued so far, except that a
+    // button pressed and released within one frame is released at the next one.
+    void ApplyPending();
+    // Emu thread, at the end of EmuFrame. presents is false when nothing will ever present
+    // the frame, e.g. headless.
+    void EndFrame(bool presents);
+
+    // Host thread, each time the render manager ran a frame.
+    void OnFramePresented();
+
+    Stats GetStats();
+    void ResetStats();
+} // namespace OpenEmuInput
@@ -0,0 +1,308 @@
+#include "OpenEmuInputMovie.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <vector>
+
+#include "ext/xxhash.h"
+#include "zstd/lib/zstd.h"
+
+#include "Common/File/FileUtil.h"
+#include "Common/Log.h"
+#include "Core/CoreTiming.h"
+#include "Core/ELF/ParamSFO.h"
+#include "Core/HLE/sceCtrl.h"
+#include "Core/MemMap.h"
+#include "Core/SaveState.h"
+
+#include "OpenEmuFastForward.h"
+#include "OpenEmuRunAhead.h"
+
+extern const char *PPSSPP_GIT_VERSION;
+
+namespace OpenEmuInputMovie {
+    static const uint32_t FILE_VERSION = 1;
+
+    struct FileHeader {
+        char magic[4];  // "OEMV"
+        uint32_t version;
+        char build[64];
+        char discID[16];
+        // Host time when recording started, only for people looking at the file.
+        int64_t recordedAt;
+        uint32_t hashInterval;
+        uint32_t frameCount;
+        uint32_t hashCount;
+        uint32_t stateBytes;
+        uint32_t compressedStateBytes;
+        uint32_t reserved;
+    };
+
+    struct FrameInput {
+        uint32_t buttons;
+        float x;
+        float y;
+    };
+
+    struct StateHash {
+        uint32_t frame;
+        uint32_t reserved;
+        uint64_t hash;
+    };
+
+    static std::mutex lock;
+    static Mode mode = Mode::OFF;
+    // Waiting for the next boundary to save or load the state.
+    static bool starting = false;
+    static Path movieFile;
+    static int64_t recordedAt = 0;
+    static std::vector<uint8_t> state;
+    static std::vector<FrameInput> inputs;
+    static std::vector<StateHash> hashes;
+    static size_t nextHash = 0;
+    static uint64_t frame = 0;
+    // Run-ahead setting we turned off for the movie, restored by Stop. 0 if none.
+    static int suspendedRunAhead = 0;
+    // Fast-forward is held at NORMAL, released by Stop.
+    static bool fastForwardForced = false;
+    static Stats stats;
+
+    static uint64_t HashState() {
+        // All of RAM, kernel included, seeded with the tick count so timing drift shows too.
+        const uint8_t *ram = Memory::GetPointerUnchecked(PSP_GetKernelMemoryBase());
+        return XXH3_64bits_withSeed(ram, Memory::g_MemorySize, (uint64_t)CoreTiming::GetTicks());
+    }
+
+    static void ResetLocked(Mode newMode) {
+        mode = newMode;
+        starting = newMode != Mode::OFF;
+        state.clear();
+        inputs.clear();
+        hashes.clear();
+        nextHash = 0;
+        frame = 0;
+        stats = Stats();
+        stats.mode = newMode;
+        stats.firstDesyncFrame = -1;
+    }
+
+    void StartRecording(const Path &filename) {
+        std::lock_guard<std::mutex> guard(lock);
+        ResetLocked(Mode::RECORDING);
+        movieFile = filename;
+        recordedAt = (int64_t)time(nullptr);
+    }
+
+    bool StartReplay(const Path &filename, std::string *error) {
+        FILE *file = File::OpenCFile(filename, "rb");
+        if (!file) {
+            *error = "can't open " + filename.ToString();
+            return false;
+        }
+
+        FileHeader header;
+        std::vector<uint8_t> compressed;
+        std::vector<uint8_t> decompressed;
+        std::vector<FrameInput> movieInputs;
+        std::vector<StateHash> movieHashes;
+        bool ok = fread(&header, sizeof(header), 1, file) == 1 && !memcmp(header.magic, "OEMV", 4) && header.version == FILE_VERSION;
+        if (ok) {
+            compressed.resize(header.compressedStateBytes);
+            movieInputs.resize(header.frameCount);
+            movieHashes.resize(header.hashCount);
+            ok = fread(compressed.data(), 1, compressed.size(), file) == compressed.size() &&
+                fread(movieInputs.data(), sizeof(FrameInput), movieInputs.size(), file) == movieInputs.size() &&
+                fread(movieHashes.data(), sizeof(StateHash), movieHashes.size(), file) == movieHashes.size();
+        }
+        fclose(file);
+        if (ok) {
+            decompressed.resize(header.stateBytes);
+            size_t size = ZSTD_decompress(decompressed.data(), decompressed.size(), compressed.data(), compressed.size());
+            ok = !ZSTD_isError(size) && size == decompressed.size();
+        }
+        if (!ok) {
+            *error = filename.ToString() + " isn't a movie or is truncated";
+            return false;
+        }
+
+        header.discID[sizeof(header.discID) - 1] = '\0';
+        header.build[sizeof(header.build) - 1] = '\0';
+        if (g_paramSFO.GetDiscID() != header.discID) {
+            *error = std::string("movie is for ") + header.discID;
+            return false;
+        }
+        // Comparing builds is the point, the state usually loads fine across them.
+        if (strcmp(header.build, PPSSPP_GIT_VERSION) != 0)
+            INFO_LOG(SYSTEM, "Movie %s was recorded with %s", filename.c_str(), header.build);
+
+        std::lock_guard<std::mutex> guard(lock);
+        ResetLocked(Mode::REPLAYING);
+        movieFile = filename;
+        recordedAt = header.recordedAt;
+        state.swap(decompressed);
+        inputs.swap(movieInputs);
+        hashes.swap(movieHashes);
+        stats.movieFrames = inputs.size();
+        return true;
+    }
+
+    static void Write() {
+        std::vector<uint8_t> compressed(ZSTD_compressBound(state.size()));
+        size_t size = ZSTD_compress(compressed.data(), compressed.size(), state.data(), state.size(), 3);
+        if (ZSTD_isError(size)) {
+            ERROR_LOG(SYSTEM, "Movie: compression failed: %s", ZSTD_getErrorName(size));
+            return;
+        }
+
+        FILE *file = File::OpenCFile(movieFile, "wb");
+        if (!file) {
+            ERROR_LOG(SYSTEM, "Movie: can't write %s", movieFile.c_str());
+            return;
+        }
+        FileHeader header = {};
+        memcpy(header.magic, "OEMV", 4);
+        header.version = FILE_VERSION;
+        strncpy(header.build, PPSSPP_GIT_VERSION, sizeof(header.build) - 1);
+        strncpy(header.discID, g_paramSFO.GetDiscID().c_str(), sizeof(header.discID) - 1);
+        header.recordedAt = recordedAt;
+        header.hashInterval = HASH_INTERVAL;
+        header.frameCount = (uint32_t)inputs.size();
+        header.hashCount = (uint32_t)hashes.size();
+        header.stateBytes = (uint32_t)state.size();
+        header.compressedStateBytes = (uint32_t)size;
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(compressed.data(), 1, size, file) == size &&
+            fwrite(inputs.data(), sizeof(FrameInput), inputs.size(), file) == inputs.size() &&
+            fwrite(hashes.data(), sizeof(StateHash), hashes.size(), file) == hashes.size();
+        if (fclose(file) != 0 || !ok)
+            ERROR_LOG(SYSTEM, "Movie: failed writing %s", movieFile.c_str());
+        else
+            INFO_LOG(SYSTEM, "Movie: %u frames to %s", header.frameCount, movieFile.c_str());
+    }
+
+    void Stop() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (mode == Mode::RECORDING && !starting)
+            Write();
+        mode = Mode::OFF;
+        starting = false;
+        stats.mode = Mode::OFF;
+        // Unless someone else turned it back on meanwhile.
+        if (suspendedRunAhead > 0 && OpenEmuRunAhead::GetFrames() == 0)
+            OpenEmuRunAhead::SetFrames(suspendedRunAhead);
+        suspendedRunAhead = 0;
+        if (fastForwardForced)
+            OpenEmuFastForward::ForceNormal(false);
+        fastForwardForced = false;
+    }
+
+    static void SetInput(const FrameInput &input) {
+        uint32_t current = __CtrlPeekButtons();
+        if (current & ~input.buttons)
+            __CtrlButtonUp(current & ~input.buttons);
+        if (input.buttons & ~current)
+            __CtrlButtonDown(input.buttons & ~current);
+        __CtrlSetAnalogXY(0, input.x, input.y);
+    }
+
+    static void Record() {
+        if (starting) {
+            if (SaveState::SaveToRam(state) != CChunkFileReader::ERROR_NONE) {
+                ERROR_LOG(SYSTEM, "Movie: can't save the starting state, not recording");
+                mode = Mode::OFF;
+                stats.mode = Mode::OFF;
+                return;
+            }
+            starting = false;
+        }
+
+        FrameInput input;
+        input.buttons = __CtrlPeekButtons();
+        __CtrlPeekAnalog(0, &input.x, &input.y);
+        inputs.push_back(input);
+        if (frame % HASH_INTERVAL == 0)
+            hashes.push_back({ (uint32_t)frame, 0, HashState() });
+        frame++;
+        stats.frames = frame;
+    }
+
+    static void Replay() {
+        if (starting) {
+            std::string error;
+            // LoadFromRam may consume the buffer, the movie keeps its copy.
+            std::vector<uint8_t> copy = state;
+            if (SaveState::LoadFromRam(copy, &error) != CChunkFileReader::ERROR_NONE) {
+                ERROR_LOG(SYSTEM, "Movie: can't load the starting state: %s", error.c_str());
+                mode = Mode::OFF;
+                stats.mode = Mode::OFF;
+                return;
+            }
+            starting = false;
+        }
+
+        if (frame >= inputs.size()) {
+            if (!stats.finished) {
+                SetInput({ 0, 0.0f, 0.0f });
+                stats.finished = true;
+            }
+            return;
+        }
+
+        SetInput(inputs[frame]);
+        if (nextHash < hashes.size() && hashes[nextHash].frame == frame) {
+            stats.hashChecks++;
+            if (HashState() != hashes[nextHash].hash) {
+                if (stats.desyncs == 0) {
+                    stats.firstDesyncFrame = (int64_t)frame;
+                    WARN_LOG(SYSTEM, "Movie: desynced at frame %llu", (unsigned long long)frame);
+                }
+                stats.desyncs++;
+            }
+            nextHash++;
+        }
+        frame++;
+        stats.frames = frame;
+    }
+
+    // Run-ahead applies the input to frames ahead of the one it belongs to, the movie would
+    // desync. Right before RunFrame, so it's off for every frame the movie covers.
+    static void SuspendRunAhead() {
+        int frames = OpenEmuRunAhead::GetFrames();
+        if (frames == 0)
+            return;
+        WARN_LOG(SYSTEM, "Movie: turning off run-ahead (%d frames) until the movie stops", frames);
+        suspendedRunAhead = frames;
+        OpenEmuRunAhead::SetFrames(0);
+    }
+
+    // Input is applied once per boundary, and fast-forward runs several emulated frames
+    // between two of them, a different number each time when unbounded. Held rather than
+    // set, the plugin sets the speed from OpenEmu's rate every frame.
+    static void SuspendFastForward() {
+        if (fastForwardForced)
+            return;
+        int speed = OpenEmuFastForward::GetSpeed();
+        if (speed != OpenEmuFastForward::NORMAL)
+            WARN_LOG(SYSTEM, "Movie: running at normal speed instead of %d until the movie stops", speed);
+        OpenEmuFastForward::ForceNormal(true);
+        fastForwardForced = true;
+    }
+
+    void OnFrameBoundary() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (mode != Mode::OFF) {
+            SuspendRunAhead();
+            SuspendFastForward();
+        }
+        if (mode == Mode::RECORDING)
+            Record();
+        else if (mode == Mode::REPLAYING)
+            Replay();
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats;
+    }
+} // namespace OpenEmuInputMovie
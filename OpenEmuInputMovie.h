@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "Common/File/Path.h"
+
+// Input movies, for running the same gameplay on different builds and comparing frame
+// times. A movie is a save state taken where recording started, followed by the
+// controller state every frame boundary applied: the sceCtrl buttons and the analog
+// X/Y. Replaying loads the state and sets exactly that input at the same boundaries,
+// whatever the host sends meanwhile.
+//
+// The state carries the RTC base, the kernel's RNG and CoreTiming, so nothing seeded
+// from the host survives into the replay. Every HASH_INTERVAL frames a hash of emulated
+// RAM and the CPU tick count is stored, and a replay that hashes differently has
+// desynced. Run-ahead applies input ahead of the frame, and fast-forward runs several
+// frames per boundary, so both are turned off while a movie records or replays and back
+// on when it stops.
+namespace OpenEmuInputMovie {
+    static const int HASH_INTERVAL = 60;
+
+    enum class Mode {
+        OFF,
+        RECORDING,
+        REPLAYING,
+    };
+
+    struct Stats {
+        Mode mode;
+        // Recorded or replayed so far, and the length of the movie being replayed.
+        uint64_t frames;
+        uint64_t movieFrames;
+        uint64_t hashChecks;
+        uint64_t desyncs;
+        // -1 while in sync.
+        int64_t firstDesyncFrame;
+        // The replay ran out of input.
+        bool finished;
+    };
+
+    // Any thread. Both take effect at the emu thread's next frame boundary, which is where
+    // the state gets saved or loaded.
+    void StartRecording(const Path &filename);
+    // Reads the movie right away, false with a reason if it can't be used.
+    bool StartReplay(const Path &filename, std::string *error);
+    // With the emu thread paused or stopped. Writes a recording out.
+    void Stop();
+
+    // Emu thread, right after OpenEmuInput::ApplyPending.
+    void OnFrameBoundary();
+
+    Stats GetStats();
+} // namespace OpenEmuInputMovie
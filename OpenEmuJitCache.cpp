@@ -0,0 +1,337 @@
+#include "OpenEmuJitCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "Common/File/FileUtil.h"
+#include "Common/Log.h"
+#include "Common/TimeUtil.h"
+#include "Core/Config.h"
+#include "Core/CoreParameter.h"
+#include "Core/ELF/ParamSFO.h"
+#include "Core/MemMap.h"
+#include "Core/MIPS/JitCommon/JitBlockCache.h"
+#include "Core/MIPS/JitCommon/JitCommon.h"
+#include "Core/System.h"
+
+#include "OpenEmuFramePacer.h"
+
+extern const char *PPSSPP_GIT_VERSION;
+
+namespace OpenEmuJitCache {
+    static const uint32_t FILE_VERSION = 1;
+    // Per frame when there's no idle time before the frame's deadline to use instead.
+    static const double BUSY_BUDGET_MS = 1.0;
+    static const double MAX_BUDGET_MS = 4.0;
+    // Left of the idle time, so the frame still starts on time.
+    static const double IDLE_MARGIN_MS = 1.0;
+    // Deferred blocks are checked again this often.
+    static const int RETRY_FRAMES = 120;
+    static const size_t MAX_ENTRIES = 1 << 16;
+    // Hashed to key the cache to the image, the volume descriptors are in here.
+    static const size_t IMAGE_HASH_BYTES = 1024 * 1024;
+    static const double FRAME_MS = 1000.0 / 59.94;
+
+    struct FileHeader {
+        char magic[4];  // "OEJC"
+        uint32_t version;
+        uint64_t imageHash;
+        char build[64];
+        uint32_t count;
+        uint32_t reserved;
+    };
+
+    struct Entry {
+        uint32_t address;
+        uint32_t bytes;
+        uint64_t codeHash;
+    };
+
+    static std::atomic<bool> enabled(false);
+
+    // Emu thread only. OnGameStarted and OnGameStopped run while it's stopped.
+    static bool active = false;
+    static Path cacheFile;
+    static uint64_t imageHash = 0;
+    // In the order they were first compiled.
+    static std::vector<Entry> entries;
+    static std::unordered_set<uint64_t> known;
+    // Compiled from different code than recorded, dropped on the next save.
+    static std::vector<bool> stale;
+    static bool entriesChanged = false;
+    static std::deque<size_t> pending;
+    static std::vector<size_t> deferred;
+    static int framesUntilRetry = 0;
+    // How far into the block cache has been recorded. Starts over when the JIT clears it.
+    static int recordedBlocks = 0;
+    static int blocksAtBoundary = 0;
+    static double frameStart = 0.0;
+
+    static std::mutex statsLock;
+    static Stats stats;
+
+    void SetEnabled(bool enable) {
+        enabled = enable;
+    }
+
+    bool IsEnabled() {
+        return enabled;
+    }
+
+    // FNV-1a, blocks are a few dozen instructions.
+    static uint64_t Hash64(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+        const uint8_t *bytes = (const uint8_t *)data;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static uint64_t Key(uint32_t address, uint64_t codeHash) {
+        return codeHash ^ ((uint64_t)address * 0x9E3779B97F4A7C15ULL);
+    }
+
+    static bool HashCode(uint32_t address, uint32_t bytes, uint64_t *hash) {
+        if (bytes == 0 || !Memory::IsValidRange(address, bytes))
+            return false;
+        uint64_t result = Hash64(nullptr, 0);
+        for (uint32_t offset = 0; offset < bytes; offset += 4) {
+            // Sees through the JIT's block markers and replacement hooks to the original op.
+            uint32_t op = Memory::Read_Instruction(address + offset, true).encoding;
+            result = Hash64(&op, sizeof(op), result);
+        }
+        *hash = result;
+        return true;
+    }
+
+    static uint64_t HashImage(const Path &image) {
+        FILE *file = File::OpenCFile(image, "rb");
+        if (!file)
+            return 0;
+        std::vector<uint8_t> buffer(IMAGE_HASH_BYTES);
+        size_t read = fread(&buffer[0], 1, buffer.size(), file);
+        fclose(file);
+        uint64_t size = File::GetFileSize(image);
+        return Hash64(&buffer[0], read, Hash64(&size, sizeof(size)));
+    }
+
+    static JitBlockCacheDebugInterface *BlockCache() {
+        if (!MIPSComp::jit || PSP_CoreParameter().cpuCore != CPUCore::JIT)
+            return nullptr;
+        return MIPSComp::jit->GetBlockCacheDebugInterface();
+    }
+
+    static void Load() {
+        FILE *file = File::OpenCFile(cacheFile, "rb");
+        if (!file)
+            return;
+
+        FileHeader header;
+        const char *mismatch = nullptr;
+        if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "OEJC", 4) != 0 || header.version != FILE_VERSION)
+            mismatch = "unknown format";
+        else if (header.imageHash != imageHash)
+            mismatch = "different image";
+        else if (strncmp(header.build, PPSSPP_GIT_VERSION, sizeof(header.build) - 1) != 0)
+            mismatch = "different build";
+        if (mismatch) {
+            INFO_LOG(JIT, "Discarding %s: %s", cacheFile.c_str(), mismatch);
+            fclose(file);
+            entriesChanged = true;
+            return;
+        }
+
+        entries.resize(std::min((size_t)header.count, MAX_ENTRIES));
+        if (!entries.empty())
+            entries.resize(fread(&entries[0], sizeof(Entry), entries.size(), file));
+        fclose(file);
+        for (const Entry &entry : entries)
+            known.insert(Key(entry.address, entry.codeHash));
+        INFO_LOG(JIT, "%zu cached JIT blocks in %s", entries.size(), cacheFile.c_str());
+    }
+
+    static void Save() {
+        File::CreateFullPath(cacheFile.NavigateUp());
+        FILE *file = File::OpenCFile(cacheFile, "wb");
+        if (!file) {
+            WARN_LOG(JIT, "Can't write %s", cacheFile.c_str());
+            return;
+        }
+        FileHeader header = {};
+        memcpy(header.magic, "OEJC", 4);
+        header.version = FILE_VERSION;
+        header.imageHash = imageHash;
+        strncpy(header.build, PPSSPP_GIT_VERSION, sizeof(header.build) - 1);
+        std::vector<Entry> kept;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (i >= stale.size() || !stale[i])
+                kept.push_back(entries[i]);
+        }
+        header.count = (uint32_t)kept.size();
+        fwrite(&header, sizeof(header), 1, file);
+        if (!kept.empty())
+            fwrite(&kept[0], sizeof(Entry), kept.size(), file);
+        fclose(file);
+        entriesChanged = false;
+    }
+
+    // Adds the blocks compiled since the last call to the list.
+    static void Record(JitBlockCacheDebugInterface *blocks) {
+        int count = blocks->GetNumBlocks();
+        if (count < recordedBlocks)
+            recordedBlocks = 0;
+        for (int i = recordedBlocks; i < count && entries.size() < MAX_ENTRIES; i++) {
+            JitBlockMeta meta = blocks->GetBlockMeta(i);
+            uint64_t hash;
+            if (!meta.valid || !HashCode(meta.addr, meta.sizeInBytes, &hash))
+                continue;
+            if (known.insert(Key(meta.addr, hash)).second) {
+                entries.push_back({ meta.addr, meta.sizeInBytes, hash });
+                entriesChanged = true;
+            }
+        }
+        recordedBlocks = count;
+    }
+
+    void OnGameStarted() {
+        active = false;
+        entries.clear();
+        known.clear();
+        stale.clear();
+        entriesChanged = false;
+        pending.clear();
+        deferred.clear();
+        framesUntilRetry = RETRY_FRAMES;
+        recordedBlocks = 0;
+        {
+            std::lock_guard<std::mutex> guard(statsLock);
+            stats = Stats();
+        }
+
+        std::string discID = g_paramSFO.GetDiscID();
+        if (!enabled || !BlockCache() || discID.empty())
+            return;
+        cacheFile = g_Config.appCacheDirectory / (discID + ".oejit");
+        imageHash = HashImage(PSP_CoreParameter().fileToStart);
+        active = true;
+
+        Load();
+        stale.assign(entries.size(), false);
+        for (size_t i = 0; i < entries.size(); i++)
+            pending.push_back(i);
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.loaded = entries.size();
+    }
+
+    void OnGameStopped() {
+        if (!active)
+            return;
+        if (JitBlockCacheDebugInterface *blocks = BlockCache())
+            Record(blocks);
+        if (entriesChanged)
+            Save();
+        active = false;
+
+        Stats session = GetStats();
+        INFO_LOG(JIT, "JIT cache: %llu of %llu blocks precompiled in %.1f ms, %llu compiled by the game in %llu frames (%llu over a frame)",
+            (unsigned long long)session.precompiled, (unsigned long long)session.loaded, session.precompileMs, (unsigned long long)session.runtimeCompiles,
+            (unsigned long long)session.compileFrames, (unsigned long long)session.stutterFrames);
+    }
+
+    void OnFrameBoundary() {
+        if (!active)
+            return;
+        JitBlockCacheDebugInterface *blocks = BlockCache();
+        if (!blocks)
+            return;
+
+        if (--framesUntilRetry <= 0) {
+            pending.insert(pending.end(), deferred.begin(), deferred.end());
+            deferred.clear();
+            framesUntilRetry = RETRY_FRAMES;
+        }
+
+        if (!pending.empty()) {
+            // Preferably the time the pacer would otherwise sleep away before this frame.
+            double idleMs = OpenEmuFramePacer::TimeUntilNextFrame() * 1000.0 - IDLE_MARGIN_MS;
+            double budgetMs = idleMs > BUSY_BUDGET_MS ? std::min(idleMs, MAX_BUDGET_MS) : BUSY_BUDGET_MS;
+            double start = time_now_d();
+            double deadline = start + budgetMs / 1000.0;
+            uint64_t compiled = 0;
+            uint64_t already = 0;
+
+            std::lock_guard<std::recursive_mutex> guard(MIPSComp::jitLock);
+            while (!pending.empty() && time_now_d() < deadline) {
+                size_t index = pending.front();
+                pending.pop_front();
+                const Entry &entry = entries[index];
+                uint64_t hash;
+                bool matches = HashCode(entry.address, entry.bytes, &hash) && hash == entry.codeHash;
+                if (blocks->GetBlockNumberFromStartAddress(entry.address) >= 0) {
+                    // The game got there first. If it compiled other code than we recorded,
+                    // the entry is out of date, the new code gets recorded instead.
+                    if (matches) {
+                        already++;
+                    } else {
+                        stale[index] = true;
+                        entriesChanged = true;
+                    }
+                    continue;
+                }
+                if (!matches) {
+                    deferred.push_back(index);
+                    continue;
+                }
+                MIPSComp::jit->Compile(entry.address);
+                compiled++;
+            }
+
+            std::lock_guard<std::mutex> statsGuard(statsLock);
+            stats.precompiled += compiled;
+            stats.alreadyCompiled += already;
+            stats.deferred = deferred.size();
+            stats.precompileMs += (time_now_d() - start) * 1000.0;
+        }
+
+        blocksAtBoundary = blocks->GetNumBlocks();
+    }
+
+    void BeginFrame() {
+        frameStart = time_now_d();
+    }
+
+    void EndFrame() {
+        if (!active)
+            return;
+        JitBlockCacheDebugInterface *blocks = BlockCache();
+        if (!blocks)
+            return;
+
+        double ms = (time_now_d() - frameStart) * 1000.0;
+        int count = blocks->GetNumBlocks();
+        // Fewer than at the boundary, the JIT cleared its cache during the frame.
+        int compiled = count >= blocksAtBoundary ? count - blocksAtBoundary : count;
+        Record(blocks);
+        if (compiled == 0)
+            return;
+
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.runtimeCompiles += compiled;
+        stats.compileFrames++;
+        stats.compileFrameMs += ms;
+        if (ms > FRAME_MS)
+            stats.stutterFrames++;
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(statsLock);
+        return stats;
+    }
+} // namespace OpenEmuJitCache
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+// Remembers which MIPS blocks a game's JIT compiled, across sessions, and compiles them
+// again at the frame boundary of the next session before the game reaches them. The
+// first minutes of each area otherwise stutter on compiles every session.
+//
+// PPSSPP's generated code points into its own code space and at other blocks, so it
+// can't be saved. What's saved is each block's address, length and a hash of its MIPS
+// code, in <appCacheDirectory>/<discID>.oejit, in the order the blocks were first
+// compiled. The file is keyed by a hash of the image and by the core's build. A block is
+// only precompiled if the code at its address hashes the same as when it was recorded,
+// so overlays that aren't loaded yet wait, and self-modifying code is never compiled from
+// a stale copy. Whatever the game changes afterwards the JIT invalidates as usual.
+namespace OpenEmuJitCache {
+    struct Stats {
+        // Blocks in the cache file when the game started.
+        uint64_t loaded;
+        uint64_t precompiled;
+        // Compiled by the game before we got to them.
+        uint64_t alreadyCompiled;
+        // Code at the address didn't match (yet), retried now and then.
+        uint64_t deferred;
+        double precompileMs;
+        // Blocks the game compiled itself, and the frames that did. Comparing these between
+        // a cold and a warm session is what the cache saved.
+        uint64_t runtimeCompiles;
+        uint64_t compileFrames;
+        // Compile frames that took longer than a frame to emulate.
+        uint64_t stutterFrames;
+        double compileFrameMs;
+    };
+
+    // Off unless enabled, before OnGameStarted.
+    void SetEnabled(bool enabled);
+    bool IsEnabled();
+
+    // Once PSP_Init is done and the disc id is known. Loads the block list.
+    void OnGameStarted();
+    // Before PSP_Shutdown. Writes the block list back if it grew.
+    void OnGameStopped();
+
+    // Emu thread, between frames and before the pacer's wait. Precompiles in the time the
+    // pacer would sleep away, or within a small budget when there's none.
+    void OnFrameBoundary();
+    // Emu thread, around the frame once the pacer let it start. Records the blocks the
+    // game compiled during it.
+    void BeginFrame();
+    void EndFrame();
+
+    Stats GetStats();
+} // namespace OpenEmuJitCache
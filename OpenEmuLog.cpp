@@ -0,0 +1,149 @@
+#include "OpenEmuLog.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "Common/Thread/ThreadUtil.h"
+
+// The drain thread wakes up on its own this often. Producers only signal it when their
+// ring gets half full, so a steady trickle never puts a syscall on the logging thread.
+static const auto DRAIN_INTERVAL = std::chrono::milliseconds(2);
+
+static std::atomic<uint64_t> nextListenerId(1);
+
+AsyncLogListener::AsyncLogListener(FILE *out) : out_(out), id_(nextListenerId++) {
+    thread_ = std::thread(&AsyncLogListener::DrainThread, this);
+}
+
+AsyncLogListener::~AsyncLogListener() {
+    {
+        std::lock_guard<std::mutex> guard(drainLock_);
+        running_ = false;
+    }
+    drainCond_.notify_all();
+    thread_.join();
+}
+
+AsyncLogListener::ThreadRing *AsyncLogListener::RingForThisThread() {
+    // Keyed by listener id rather than pointer, so a new listener at a recycled address
+    // doesn't pick up a ring that belonged to a deleted one.
+    thread_local uint64_t cachedId = 0;
+    thread_local ThreadRing *cachedRing = nullptr;
+    if (cachedId == id_)
+        return cachedRing;
+
+    std::lock_guard<std::mutex> guard(ringsLock_);
+    std::thread::id self = std::this_thread::get_id();
+    cachedRing = nullptr;
+    for (auto &ring : rings_) {
+        if (ring->owner == self)
+            cachedRing = ring.get();
+    }
+    if (!cachedRing) {
+        rings_.emplace_back(new ThreadRing());
+        cachedRing = rings_.back().get();
+        cachedRing->owner = self;
+    }
+    cachedId = id_;
+    return cachedRing;
+}
+
+void AsyncLogListener::Log(const LogMessage &msg) {
+    ThreadRing *ring = RingForThisThread();
+
+    uint32_t write = ring->writePos.load(std::memory_order_relaxed);
+    uint32_t queued = write - ring->readPos.load(std::memory_order_acquire);
+    if (queued >= SLOTS_PER_THREAD) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Slot &slot = ring->slots[write % SLOTS_PER_THREAD];
+    int len = snprintf(slot.text, sizeof(slot.text), "%s %s %s", msg.timestamp, msg.header, msg.msg.c_str());
+    if (len < 0)
+        len = 0;
+    len = std::min(len, (int)sizeof(slot.text) - 1);
+    // Truncated or not, every slot is exactly one line.
+    if (len > 0 && slot.text[len - 1] == '\n')
+        len--;
+    slot.text[len++] = '\n';
+    slot.length = (uint16_t)len;
+
+    ring->writePos.store(write + 1, std::memory_order_release);
+    if (queued == SLOTS_PER_THREAD / 2) {
+        // Without the lock a wakeup can get lost, the timeout covers that.
+        wakeRequested_.store(true, std::memory_order_relaxed);
+        drainCond_.notify_one();
+    }
+}
+
+bool AsyncLogListener::DrainOnce() {
+    std::vector<ThreadRing *> rings;
+    {
+        std::lock_guard<std::mutex> guard(ringsLock_);
+        for (auto &ring : rings_)
+            rings.push_back(ring.get());
+    }
+
+    uint64_t written = 0;
+    for (ThreadRing *ring : rings) {
+        uint32_t read = ring->readPos.load(std::memory_order_relaxed);
+        uint32_t write = ring->writePos.load(std::memory_order_acquire);
+        for (; read != write; read++) {
+            const Slot &slot = ring->slots[read % SLOTS_PER_THREAD];
+            fwrite(slot.text, 1, slot.length, out_);
+            written++;
+        }
+        ring->readPos.store(read, std::memory_order_release);
+    }
+
+    if (written != 0) {
+        fflush(out_);
+        std::lock_guard<std::mutex> guard(drainLock_);
+        written_ += written;
+    }
+    return written != 0;
+}
+
+void AsyncLogListener::DrainThread() {
+    SetCurrentThreadName("LogDrain");
+
+    std::unique_lock<std::mutex> lock(drainLock_);
+    while (true) {
+        uint64_t flushTarget = flushRequests_;
+        bool running = running_;
+
+        lock.unlock();
+        DrainOnce();
+        lock.lock();
+
+        flushesDone_ = flushTarget;
+        flushedCond_.notify_all();
+        if (!running)
+            break;
+        drainCond_.wait_for(lock, DRAIN_INTERVAL, [this, flushTarget] {
+            return !running_ || flushRequests_ != flushTarget || wakeRequested_.load(std::memory_order_relaxed);
+        });
+        wakeRequested_.store(false, std::memory_order_relaxed);
+    }
+}
+
+void AsyncLogListener::Flush() {
+    std::unique_lock<std::mutex> lock(drainLock_);
+    uint64_t request = ++flushRequests_;
+    drainCond_.notify_all();
+    flushedCond_.wait(lock, [this, request] { return flushesDone_ >= request; });
+}
+
+AsyncLogListener::Stats AsyncLogListener::GetStats() {
+    Stats stats{};
+    {
+        std::lock_guard<std::mutex> guard(ringsLock_);
+        for (auto &ring : rings_)
+            stats.dropped += ring->dropped.load(std::memory_order_relaxed);
+        stats.threads = (uint32_t)rings_.size();
+    }
+    std::lock_guard<std::mutex> guard(drainLock_);
+    stats.written = written_;
+    return stats;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Common/LogManager.h"
+
+// LogManager listener that never does I/O on the logging thread. Every thread that logs
+// gets its own single producer ring of fixed size slots, so Log() is an snprintf into a
+// slot plus a couple of atomics. A background thread drains the rings to the output file.
+// When a ring is full the message is dropped and counted rather than blocking the emu thread.
+//
+// Messages from one thread stay in order; messages from different threads are only
+// ordered by their timestamp prefix.
+class AsyncLogListener : public LogListener {
+public:
+    struct Stats {
+        uint64_t written;
+        uint64_t dropped;
+        uint32_t threads;
+    };
+
+    explicit AsyncLogListener(FILE *out);
+    // Drains whatever is left before returning.
+    ~AsyncLogListener();
+
+    void Log(const LogMessage &msg) override;
+
+    // Blocks until everything logged before the call is written out.
+    void Flush();
+
+    Stats GetStats();
+
+private:
+    static const int SLOT_SIZE = 256;
+    static const uint32_t SLOTS_PER_THREAD = 1024;
+
+    struct Slot {
+        uint16_t length;
+        char text[SLOT_SIZE - sizeof(uint16_t)];
+    };
+
+    struct ThreadRing {
+        Slot slots[SLOTS_PER_THREAD];
+        std::thread::id owner;
+        alignas(64) std::atomic<uint32_t> writePos{0};
+        alignas(64) std::atomic<uint32_t> readPos{0};
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    ThreadRing *RingForThisThread();
+    bool DrainOnce();
+    void DrainThread();
+
+    FILE *out_;
+    const uint64_t id_;
+
+    std::mutex ringsLock_;
+    std::vector<std::unique_ptr<ThreadRing>> rings_;
+
+    std::mutex drainLock_;
+    std::condition_variable drainCond_;
+    std::condition_variable flushedCond_;
+    uint64_t flushRequests_ = 0;
+    uint64_t flushesDone_ = 0;
+    bool running_ = true;
+    std::atomic<bool> wakeRequested_{false};
+    uint64_t written_ = 0;
+    std::thread thread_;
+};
@@ -0,0 +1,325 @@
+#include "OpenEmuMemory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+#include <unistd.h>
+
+#include "Common/Log.h"
+#include "Core/CoreParameter.h"
+#include "Core/MIPS/JitCommon/JitBlockCache.h"
+#include "Core/MIPS/JitCommon/JitCommon.h"
+#include "Core/System.h"
+#include "GPU/GPUInterface.h"
+
+#include "OpenEmuAudio.h"
+#include "OpenEmuCsoLoader.h"
+#include "OpenEmuFileLoader.h"
+#include "OpenEmuRewind.h"
+#include "OpenEmuRunAhead.h"
+
+namespace OpenEmuMemory {
+    // Accounting walks the image's page table, the resident size alone is one syscall.
+    static const int ACCOUNT_FRAMES = 30;
+    // The texture cache and the JIT take a stutter to refill, don't keep clearing them.
+    static const int TEXTURE_COOLDOWN_FRAMES = 600;
+    static const int JIT_COOLDOWN_FRAMES = 1800;
+    // Rewind is halved down to this, not further.
+    static const uint64_t MIN_REWIND_BYTES = 4 * 1024 * 1024;
+    // Rewind gets its budget back after this long below this share of the budget.
+    static const double RELAX_RATIO = 0.75;
+    static const int RELAX_FRAMES = 1800;
+
+    enum class Step {
+        FILE_CACHE,
+        REWIND,
+        TEXTURE_CACHE,
+        JIT,
+        COUNT,
+    };
+
+    static std::atomic<bool> enabled(false);
+    static std::atomic<uint64_t> budget(0);
+
+    // Emu thread only.
+    static int framesUntilAccount = 0;
+    // Where the next eviction starts looking, so every cache takes its turn.
+    static int nextStep = 0;
+    static int textureCooldown = 0;
+    static int jitCooldown = 0;
+    static int relaxedFrames = 0;
+    // Warned that nothing was left to evict, until back under budget.
+    static bool warned = false;
+    // Rewind's own budget while we hold it lower, and what we lowered it to.
+    static uint64_t rewindBudget = 0;
+    static uint64_t rewindBudgetSet = 0;
+
+    static std::mutex statsLock;
+    static Stats stats;
+    static uint64_t sampledPeak = 0;
+    // Whether the kernel's high water mark covers the same span as sampledPeak.
+    static bool kernelPeakValid = true;
+
+    const char *SubsystemName(Subsystem subsystem) {
+        switch (subsystem) {
+        case Subsystem::FILE_CACHE: return "file cache";
+        case Subsystem::TEXTURE_CACHE: return "texture cache";
+        case Subsystem::JIT: return "jit";
+        case Subsystem::SAVE_STATES: return "save states";
+        case Subsystem::AUDIO: return "audio";
+        default: return "?";
+        }
+    }
+
+    void SetEnabled(bool enable) {
+        enabled = enable;
+    }
+
+    bool IsEnabled() {
+        return enabled;
+    }
+
+    void SetBudget(uint64_t budgetBytes) {
+        budget = budgetBytes;
+    }
+
+#ifdef __APPLE__
+    uint64_t CurrentRss() {
+        task_vm_info_data_t info;
+        mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+        if (task_info(mach_task_self(), TASK_VM_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+            return 0;
+        return info.phys_footprint;
+    }
+
+    // No high water mark for the footprint that can be reset, the samples have to do.
+    static uint64_t KernelPeakRss() {
+        return 0;
+    }
+
+    static bool ResetKernelPeakRss() {
+        return false;
+    }
+#else
+    uint64_t CurrentRss() {
+        FILE *file = fopen("/proc/self/statm", "r");
+        if (!file)
+            return 0;
+        unsigned long long size = 0, resident = 0;
+        int fields = fscanf(file, "%llu %llu", &size, &resident);
+        fclose(file);
+        return fields == 2 ? resident * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+    }
+
+    static uint64_t KernelPeakRss() {
+        FILE *file = fopen("/proc/self/status", "r");
+        if (!file)
+            return 0;
+        char line[256];
+        unsigned long long kb = 0;
+        while (fgets(line, sizeof(line), file)) {
+            if (sscanf(line, "VmHWM: %llu kB", &kb) == 1)
+                break;
+        }
+        fclose(file);
+        return kb * 1024;
+    }
+
+    static bool ResetKernelPeakRss() {
+        // 5 resets VmHWM to the current RSS.
+        FILE *file = fopen("/proc/self/clear_refs", "w");
+        if (!file)
+            return false;
+        bool ok = fputs("5", file) >= 0;
+        return fclose(file) == 0 && ok;
+    }
+#endif
+
+    static uint64_t SampleRss() {
+        uint64_t rss = CurrentRss();
+        std::lock_guard<std::mutex> guard(statsLock);
+        sampledPeak = std::max(sampledPeak, rss);
+        stats.rssBytes = rss;
+        return rss;
+    }
+
+    uint64_t PeakRss() {
+        // The kernel's also catches what happened between samples.
+        uint64_t kernelPeak = KernelPeakRss();
+        std::lock_guard<std::mutex> guard(statsLock);
+        return kernelPeakValid ? std::max(sampledPeak, kernelPeak) : sampledPeak;
+    }
+
+    void ResetPeakRss() {
+        bool reset = ResetKernelPeakRss();
+        uint64_t rss = CurrentRss();
+        std::lock_guard<std::mutex> guard(statsLock);
+        kernelPeakValid = reset;
+        sampledPeak = rss;
+        stats.rssBytes = rss;
+    }
+
+    static JitBlockCacheDebugInterface *BlockCache() {
+        if (!MIPSComp::jit || PSP_CoreParameter().cpuCore != CPUCore::JIT)
+            return nullptr;
+        return MIPSComp::jit->GetBlockCacheDebugInterface();
+    }
+
+    static void Account(uint64_t rss, Usage *usage, uint64_t *other, uint64_t *mappedBytes) {
+        for (int i = 0; i < (int)Subsystem::COUNT; i++) {
+            usage[i].measured = false;
+            usage[i].bytes = 0;
+            usage[i].items = 0;
+        }
+
+        Usage &file = usage[(int)Subsystem::FILE_CACHE];
+        *mappedBytes = OpenEmuFileLoader::ResidentBytes();
+        file.measured = true;
+        file.bytes = *mappedBytes + OpenEmuCsoLoader::GetStats().memoryBytes;
+
+        // Decoded textures are driver allocations, they end up in "other".
+        if (JitBlockCacheDebugInterface *blocks = BlockCache())
+            usage[(int)Subsystem::JIT].items = blocks->GetNumBlocks();
+
+        OpenEmuRewind::Stats rewind = OpenEmuRewind::GetStats();
+        OpenEmuRunAhead::Stats runAhead = OpenEmuRunAhead::GetStats();
+        Usage &states = usage[(int)Subsystem::SAVE_STATES];
+        states.measured = true;
+        states.bytes = rewind.memoryBytes + runAhead.snapshotBytes;
+        states.items = rewind.snapshots + (runAhead.snapshotBytes != 0 ? 1 : 0);
+
+        Usage &audio = usage[(int)Subsystem::AUDIO];
+        audio.measured = true;
+        audio.bytes = OpenEmuAudio::GetStats().memoryBytes;
+
+        uint64_t accounted = 0;
+        for (int i = 0; i < (int)Subsystem::COUNT; i++)
+            accounted += usage[i].bytes;
+        *other = rss > accounted ? rss - accounted : 0;
+    }
+
+    // One step, the cheapest to refill that still has something to give. Returns the
+    // subsystem that gave memory back, COUNT if none could.
+    static Subsystem Evict(uint64_t mappedBytes) {
+        for (int tries = 0; tries < (int)Step::COUNT; tries++) {
+            Step step = (Step)nextStep;
+            nextStep = (nextStep + 1) % (int)Step::COUNT;
+
+            switch (step) {
+            case Step::FILE_CACHE:
+                if (mappedBytes == 0)
+                    break;
+                OpenEmuFileLoader::Trim();
+                return Subsystem::FILE_CACHE;
+
+            case Step::REWIND:
+            {
+                OpenEmuRewind::Stats rewind = OpenEmuRewind::GetStats();
+                if (rewind.memoryBytes <= MIN_REWIND_BYTES)
+                    break;
+                // Someone else set a budget since we last did, that's the one to go back to.
+                if (rewindBudget == 0 || rewind.budgetBytes != rewindBudgetSet)
+                    rewindBudget = rewind.budgetBytes;
+                rewindBudgetSet = std::max(rewind.memoryBytes / 2, MIN_REWIND_BYTES);
+                OpenEmuRewind::SetBudget((size_t)rewindBudgetSet);
+                return Subsystem::SAVE_STATES;
+            }
+
+            case Step::TEXTURE_CACHE:
+                if (!gpu || textureCooldown > 0)
+                    break;
+                gpu->ClearCacheNextFrame();
+                textureCooldown = TEXTURE_COOLDOWN_FRAMES;
+                return Subsystem::TEXTURE_CACHE;
+
+            case Step::JIT:
+                if (!BlockCache() || jitCooldown > 0)
+                    break;
+                {
+                    std::lock_guard<std::recursive_mutex> guard(MIPSComp::jitLock);
+                    MIPSComp::jit->ClearCache();
+                }
+                jitCooldown = JIT_COOLDOWN_FRAMES;
+                return Subsystem::JIT;
+
+            default:
+                break;
+            }
+        }
+        return Subsystem::COUNT;
+    }
+
+    static void Relax(uint64_t rss, uint64_t budgetBytes) {
+        if (rewindBudget == 0)
+            return;
+        if (budgetBytes != 0 && rss > budgetBytes * RELAX_RATIO) {
+            relaxedFrames = 0;
+            return;
+        }
+        relaxedFrames += ACCOUNT_FRAMES;
+        if (relaxedFrames < RELAX_FRAMES)
+            return;
+        // Unless someone else changed it meanwhile.
+        if (OpenEmuRewind::GetStats().budgetBytes == rewindBudgetSet)
+            OpenEmuRewind::SetBudget((size_t)rewindBudget);
+        rewindBudget = 0;
+        relaxedFrames = 0;
+    }
+
+    void OnFrameBoundary() {
+        if (!enabled)
+            return;
+        uint64_t rss = SampleRss();
+        textureCooldown = std::max(0, textureCooldown - 1);
+        jitCooldown = std::max(0, jitCooldown - 1);
+        if (--framesUntilAccount > 0)
+            return;
+        framesUntilAccount = ACCOUNT_FRAMES;
+
+        Usage usage[(int)Subsystem::COUNT];
+        uint64_t other;
+        uint64_t mappedBytes;
+        Account(rss, usage, &other, &mappedBytes);
+
+        uint64_t budgetBytes = budget;
+        bool over = budgetBytes != 0 && rss > budgetBytes;
+        Subsystem evicted = Subsystem::COUNT;
+        if (over)
+            evicted = Evict(mappedBytes);
+        if (over && evicted == Subsystem::COUNT && !warned) {
+            WARN_LOG(SYSTEM, "Memory: %.1f MB resident, over the %.1f MB budget with nothing left to evict", rss / 1048576.0, budgetBytes / 1048576.0);
+            warned = true;
+        } else if (!over) {
+            warned = false;
+            nextStep = 0;
+        }
+        Relax(rss, budgetBytes);
+
+        std::lock_guard<std::mutex> guard(statsLock);
+        for (int i = 0; i < (int)Subsystem::COUNT; i++) {
+            uint64_t evictions = stats.usage[i].evictions;
+            stats.usage[i] = usage[i];
+            stats.usage[i].evictions = evictions;
+        }
+        stats.otherBytes = other;
+        stats.budgetBytes = budgetBytes;
+        if (over)
+            stats.overBudgetChecks++;
+        if (evicted != Subsystem::COUNT)
+            stats.usage[(int)evicted].evictions++;
+    }
+
+    Stats GetStats() {
+        uint64_t peak = PeakRss();
+        std::lock_guard<std::mutex> guard(statsLock);
+        Stats result = stats;
+        result.peakRssBytes = peak;
+        return result;
+    }
+} // namespace OpenEmuMemory
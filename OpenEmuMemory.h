@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+// Memory accounting and an optional budget. The process's resident size is split into what
+// the subsystems that hold large, droppable buffers can account for, plus everything else
+// (emulated RAM, code, the JIT's code space, the graphics driver and the textures in it).
+//
+// Over the budget, the caches give memory back one step at a time, cheapest to refill
+// first: the image's mapped pages, the oldest rewind snapshots, the texture cache, and the
+// JIT's blocks. Rewind gets its budget back once the process has stayed well below.
+// Resident size is the kernel's RSS on Linux and the physical footprint on macOS, which
+// is what the system kills apps over and includes GPU memory.
+namespace OpenEmuMemory {
+    enum class Subsystem {
+        FILE_CACHE,
+        TEXTURE_CACHE,
+        JIT,
+        SAVE_STATES,
+        AUDIO,
+        COUNT,
+    };
+
+    struct Usage {
+        // Not measured for subsystems whose memory lives where we can't see it.
+        bool measured;
+        uint64_t bytes;
+        // JIT blocks, snapshots.
+        uint64_t items;
+        uint64_t evictions;
+    };
+
+    struct Stats {
+        uint64_t rssBytes;
+        // Since the last ResetPeakRss, or since startup.
+        uint64_t peakRssBytes;
+        // 0 without a budget.
+        uint64_t budgetBytes;
+        // Resident but not accounted to any subsystem.
+        uint64_t otherBytes;
+        Usage usage[(int)Subsystem::COUNT];
+        // Accounting passes that found the process over budget.
+        uint64_t overBudgetChecks;
+    };
+
+    const char *SubsystemName(Subsystem subsystem);
+
+    // Any thread. Accounting costs a pass over the image's page table every few dozen
+    // frames, so it's off unless enabled.
+    void SetEnabled(bool enable);
+    bool IsEnabled();
+    // In bytes, 0 for none. Takes effect at the next accounting pass.
+    void SetBudget(uint64_t budgetBytes);
+
+    // Emu thread, between frames. Samples the resident size, accounts and evicts every
+    // few dozen frames.
+    void OnFrameBoundary();
+
+    uint64_t CurrentRss();
+    uint64_t PeakRss();
+    // Starts the peak over from the current resident size.
+    void ResetPeakRss();
+
+    Stats GetStats();
+} // namespace OpenEmuMemory
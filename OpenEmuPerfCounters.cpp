@@ -0,0 +1,249 @@
+#include "OpenEmuPerfCounters.h"
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+
+#include "Common/File/FileUtil.h"
+#include "Common/Log.h"
+#include "Common/Thread/ThreadManager.h"
+
+namespace OpenEmuPerfCounters {
+    static const size_t RECENT_FRAMES = 600;
+
+    struct alignas(64) Accumulator {
+        std::atomic<uint64_t> nanos;
+        std::atomic<uint32_t> calls;
+    };
+
+    static std::atomic<bool> enabled(false);
+    static std::atomic<bool> restart(true);
+    static Accumulator accumulators[NUM_COUNTERS];
+    static std::atomic<uint32_t> eventCounts[NUM_EVENTS];
+
+    // Emu thread only.
+    static double lastFrameEnd = 0.0;
+
+    static std::mutex framesLock;
+    static Totals totals;
+    static std::vector<FrameRecord> recent;
+    static size_t recentNext = 0;
+
+    static std::mutex dumpLock;
+    static std::mutex fileLock;
+    static FILE *dumpFile = nullptr;
+    static DumpFormat dumpFormat;
+    static int dumpFlushFrames = 60;
+    static std::vector<FrameRecord> dumpPending;
+    static std::atomic<bool> dumping(false);
+
+    static const char *const names[NUM_COUNTERS] = {
+        "run_loop",
+        "begin_host_frame",
+        "end_host_frame",
+        "thread_frame",
+        "audio_mix",
+        "pause",
+        "resume",
+        "shader_compile",
+    };
+
+    static const char *const eventNames[NUM_EVENTS] = {
+        "shader_hits",
+        "shader_misses",
+    };
+
+    const char *CounterName(Counter counter) {
+        return names[(int)counter];
+    }
+
+    const char *EventName(Event event) {
+        return eventNames[(int)event];
+    }
+
+    void SetEnabled(bool enable) {
+        restart = true;
+        enabled.store(enable, std::memory_order_relaxed);
+    }
+
+    bool IsEnabled() {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    void Add(Counter counter, uint64_t nanos) {
+        Accumulator &acc = accumulators[(int)counter];
+        acc.nanos.fetch_add(nanos, std::memory_order_relaxed);
+        acc.calls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Count(Event event, uint32_t count) {
+        eventCounts[(int)event].fetch_add(count, std::memory_order_relaxed);
+    }
+
+    static void WriteRecords(FILE *file, DumpFormat format, const std::vector<FrameRecord> &records) {
+        for (const FrameRecord &record : records) {
+            if (format == DumpFormat::BINARY) {
+                fwrite(&record.frame, sizeof(record.frame), 1, file);
+                fwrite(&record.startTime, sizeof(record.startTime), 1, file);
+                fwrite(record.ms, sizeof(record.ms), 1, file);
+                fwrite(record.calls, sizeof(record.calls), 1, file);
+                fwrite(record.events, sizeof(record.events), 1, file);
+                continue;
+            }
+
+            fprintf(file, "%llu,%.6f", (unsigned long long)record.frame, record.startTime);
+            for (int i = 0; i < NUM_COUNTERS; i++)
+                fprintf(file, ",%.4f,%u", record.ms[i], record.calls[i]);
+            for (int i = 0; i < NUM_EVENTS; i++)
+                fprintf(file, ",%u", record.events[i]);
+            fputc('\n', file);
+        }
+    }
+
+    // Takes fileLock before grabbing the pending records, so batches land in order even
+    // if two of these run on different workers.
+    static void FlushPending() {
+        std::lock_guard<std::mutex> fileGuard(fileLock);
+        std::vector<FrameRecord> records;
+        DumpFormat format;
+        {
+            std::lock_guard<std::mutex> guard(dumpLock);
+            records.swap(dumpPending);
+            format = dumpFormat;
+        }
+        if (dumpFile && !records.empty())
+            WriteRecords(dumpFile, format, records);
+    }
+
+    class PerfDumpTask : public Task {
+    public:
+        TaskType Type() const override { return TaskType::IO_BLOCKING; }
+        TaskPriority Priority() const override { return TaskPriority::LOW; }
+        void Run() override { FlushPending(); }
+    };
+
+    void EndFrame() {
+        if (!IsEnabled())
+            return;
+
+        double now = time_now_d();
+        if (restart.exchange(false)) {
+            // First frame after enabling, the accumulators cover an unknown span.
+            for (Accumulator &acc : accumulators) {
+                acc.nanos.store(0, std::memory_order_relaxed);
+                acc.calls.store(0, std::memory_order_relaxed);
+            }
+            for (std::atomic<uint32_t> &count : eventCounts)
+                count.store(0, std::memory_order_relaxed);
+            lastFrameEnd = now;
+            return;
+        }
+
+        FrameRecord record;
+        record.startTime = lastFrameEnd;
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+            record.ms[i] = (float)(accumulators[i].nanos.exchange(0, std::memory_order_relaxed) / 1e6);
+            record.calls[i] = accumulators[i].calls.exchange(0, std::memory_order_relaxed);
+        }
+        for (int i = 0; i < NUM_EVENTS; i++)
+            record.events[i] = eventCounts[i].exchange(0, std::memory_order_relaxed);
+        lastFrameEnd = now;
+
+        {
+            std::lock_guard<std::mutex> guard(framesLock);
+            record.frame = totals.frames++;
+            for (int i = 0; i < NUM_COUNTERS; i++) {
+                totals.ms[i] += record.ms[i];
+                totals.calls[i] += record.calls[i];
+            }
+            for (int i = 0; i < NUM_EVENTS; i++)
+                totals.events[i] += record.events[i];
+            if (recent.size() < RECENT_FRAMES) {
+                recent.push_back(record);
+            } else {
+                recent[recentNext] = record;
+            }
+            recentNext = (recentNext + 1) % RECENT_FRAMES;
+        }
+
+        if (dumping.load(std::memory_order_relaxed)) {
+            bool flush;
+            {
+                std::lock_guard<std::mutex> guard(dumpLock);
+                dumpPending.push_back(record);
+                flush = (int)dumpPending.size() >= dumpFlushFrames;
+            }
+            if (flush)
+                g_threadManager.EnqueueTask(new PerfDumpTask());
+        }
+    }
+
+    Totals GetTotals() {
+        std::lock_guard<std::mutex> guard(framesLock);
+        return totals;
+    }
+
+    std::vector<FrameRecord> GetRecentFrames() {
+        std::lock_guard<std::mutex> guard(framesLock);
+        std::vector<FrameRecord> result;
+        result.reserve(recent.size());
+        if (recent.size() < RECENT_FRAMES) {
+            result = recent;
+        } else {
+            result.insert(result.end(), recent.begin() + recentNext, recent.end());
+            result.insert(result.end(), recent.begin(), recent.begin() + recentNext);
+        }
+        return result;
+    }
+
+    void Reset() {
+        std::lock_guard<std::mutex> guard(framesLock);
+        totals = Totals();
+        recent.clear();
+        recentNext = 0;
+    }
+
+    bool StartDump(const Path &filename, DumpFormat format, int flushFrames) {
+        StopDump();
+
+        FILE *file = File::OpenCFile(filename, "wb");
+        if (!file) {
+            ERROR_LOG(SYSTEM, "Perf counters: can't open %s for writing", filename.c_str());
+            return false;
+        }
+
+        if (format == DumpFormat::BINARY) {
+            const uint32_t header[4] = { 0x43465050, 2, NUM_COUNTERS, NUM_EVENTS };  // "PPFC"
+            fwrite(header, sizeof(header), 1, file);
+        } else {
+            fprintf(file, "frame,start_time");
+            for (int i = 0; i < NUM_COUNTERS; i++)
+                fprintf(file, ",%s_ms,%s_calls", names[i], names[i]);
+            for (int i = 0; i < NUM_EVENTS; i++)
+                fprintf(file, ",%s", eventNames[i]);
+            fputc('\n', file);
+        }
+
+        std::lock_guard<std::mutex> fileGuard(fileLock);
+        std::lock_guard<std::mutex> guard(dumpLock);
+        dumpFile = file;
+        dumpFormat = format;
+        dumpFlushFrames = flushFrames > 0 ? flushFrames : 1;
+        dumpPending.clear();
+        dumping = true;
+        INFO_LOG(SYSTEM, "Perf counters: dumping to %s", filename.c_str());
+        return true;
+    }
+
+    void StopDump() {
+        if (!dumping.exchange(false))
+            return;
+
+        FlushPending();
+        std::lock_guard<std::mutex> fileGuard(fileLock);
+        if (dumpFile) {
+            fclose(dumpFile);
+            dumpFile = nullptr;
+        }
+    }
+} // namespace OpenEmuPerfCounters
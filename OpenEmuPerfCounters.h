@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Common/File/Path.h"
+#include "Common/TimeUtil.h"
+
+// Where a frame's time goes. Every counter is a pair of relaxed atomics (time and calls)
+// on its own cache line, so the emu thread and the host thread can add to theirs without
+// contending. The emu thread folds them into a per-frame record at the end of each
+// EmuFrame. Disabled, a timed scope costs one relaxed load.
+namespace OpenEmuPerfCounters {
+    enum class Counter {
+        RUN_LOOP,          // PSP_RunLoopUntil: CPU/JIT plus GE emulation.
+        BEGIN_HOST_FRAME,  // gpu->BeginHostFrame
+        END_HOST_FRAME,    // gpu->EndHostFrame
+        THREAD_FRAME,      // GLRenderManager::ThreadFrame on the host thread.
+        AUDIO_MIX,         // __AudioMix in NativeMix.
+        PAUSE,             // Emu thread pause transitions.
+        RESUME,            // Emu thread resume transitions.
+        SHADER_COMPILE,    // ThreadFrame of frames that compiled shaders, see OpenEmuShaderCache.
+        COUNT,
+    };
+    static const int NUM_COUNTERS = (int)Counter::COUNT;
+
+    // Things that happened during a frame that aren't time, counted the same way.
+    enum class Event {
+        SHADER_HIT,        // Variants compiled that an earlier session had used too.
+        SHADER_MISS,       // Variants compiled for the first time.
+        COUNT,
+    };
+    static const int NUM_EVENTS = (int)Event::COUNT;
+
+    struct FrameRecord {
+        uint64_t frame;
+        double startTime;  // time_now_d() at the end of the previous frame.
+        float ms[NUM_COUNTERS];
+        uint32_t calls[NUM_COUNTERS];
+        uint32_t events[NUM_EVENTS];
+    };
+
+    struct Totals {
+        uint64_t frames;
+        double ms[NUM_COUNTERS];
+        uint64_t calls[NUM_COUNTERS];
+        uint64_t events[NUM_EVENTS];
+    };
+
+    enum class DumpFormat {
+        CSV,
+        // "PPFC" magic, u32 version (2), u32 counter count, u32 event count, then the
+        // FrameRecord fields in order.
+        BINARY,
+    };
+
+    const char *CounterName(Counter counter);
+    const char *EventName(Event event);
+
+    void SetEnabled(bool enabled);
+    bool IsEnabled();
+
+    // Any thread.
+    void Add(Counter counter, uint64_t nanos);
+    void Count(Event event, uint32_t count);
+
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Counter counter) : counter_(counter), start_(IsEnabled() ? time_now_d() : -1.0) {}
+        ~ScopedTimer() {
+            if (start_ >= 0.0)
+                Add(counter_, (uint64_t)((time_now_d() - start_) * 1e9));
+        }
+
+    private:
+        Counter counter_;
+        double start_;
+    };
+
+    // Emu thread, once per EmuFrame.
+    void EndFrame();
+
+    Totals GetTotals();
+    // Up to the last few seconds of frames, oldest first.
+    std::vector<FrameRecord> GetRecentFrames();
+    void Reset();
+
+    // Appends every frame record to a file, written out in batches of flushFrames on a
+    // background worker.
+    bool StartDump(const Path &filename, DumpFormat format, int flushFrames = 60);
+    void StopDump();
+} // namespace OpenEmuPerfCounters
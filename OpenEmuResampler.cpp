@@ -0,0 +1,177 @@
+#include "ppsspp_config.h"
+
+#include "OpenEmuResampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if PPSSPP_ARCH(SSE2)
+#include <emmintrin.h>
+#elif PPSSPP_ARCH(ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+AudioResampler::AudioResampler(int inputRate, int outputRate, Quality quality)
+    : inputRate_(inputRate), outputRate_(outputRate), quality_(quality) {
+    taps_ = quality == Quality::SINC ? SINC_TAPS : 2;
+    if (quality == Quality::SINC)
+        BuildSincTable();
+    SetRateCorrection(1.0);
+    Reset();
+}
+
+void AudioResampler::BuildSincTable() {
+    const int half = SINC_TAPS / 2;
+    // When going down in rate, the cutoff has to move down with it to avoid aliasing.
+    double cutoff = std::min(1.0, (double)outputRate_ / inputRate_) * 0.95;
+
+    coeffs_.resize(SINC_PHASES * SINC_TAPS);
+    for (int phase = 0; phase < SINC_PHASES; phase++) {
+        double frac = (double)phase / SINC_PHASES;
+        float *row = &coeffs_[phase * SINC_TAPS];
+        double sum = 0.0;
+        for (int k = 0; k < SINC_TAPS; k++) {
+            double x = (k - (half - 1)) - frac;
+            double sinc = x == 0.0 ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            double window = 0.42 + 0.5 * cos(M_PI * x / half) + 0.08 * cos(2.0 * M_PI * x / half);
+            if (fabs(x) >= half)
+                window = 0.0;
+            row[k] = (float)(sinc * window);
+            sum += row[k];
+        }
+        for (int k = 0; k < SINC_TAPS; k++)
+            row[k] = (float)(row[k] / sum);
+    }
+}
+
+void AudioResampler::SetRateCorrection(double correction) {
+    correction = std::max(0.99, std::min(1.01, correction));
+    step_ = (double)inputRate_ / (outputRate_ * correction);
+}
+
+size_t AudioResampler::OutputFramesFor(size_t inputFrames) const {
+    return (size_t)ceil(inputFrames / step_) + 1;
+}
+
+void AudioResampler::Reset() {
+    // Silence as history for the left half of the filter, so the first real sample lines
+    // up with the filter center.
+    left_.assign(taps_ / 2 - 1, 0.0f);
+    right_.assign(left_.size(), 0.0f);
+    pos_ = taps_ / 2 - 1;
+}
+
+static inline float Dot16(const float *a, const float *b) {
+#if PPSSPP_ARCH(SSE2)
+    __m128 acc = _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b));
+    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + 4), _mm_loadu_ps(b + 4)));
+    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + 8), _mm_loadu_ps(b + 8)));
+    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + 12), _mm_loadu_ps(b + 12)));
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    return _mm_cvtss_f32(acc);
+#elif PPSSPP_ARCH(ARM_NEON)
+    float32x4_t acc = vmulq_f32(vld1q_f32(a), vld1q_f32(b));
+    acc = vmlaq_f32(acc, vld1q_f32(a + 4), vld1q_f32(b + 4));
+    acc = vmlaq_f32(acc, vld1q_f32(a + 8), vld1q_f32(b + 8));
+    acc = vmlaq_f32(acc, vld1q_f32(a + 12), vld1q_f32(b + 12));
+    float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+    float sum = 0.0f;
+    for (int i = 0; i < 16; i++)
+        sum += a[i] * b[i];
+    return sum;
+#endif
+}
+
+// Interleaved float stereo to s16 with saturation.
+static void ConvertToS16(const float *in, int16_t *out, size_t samples) {
+    size_t i = 0;
+#if PPSSPP_ARCH(SSE2)
+    for (; i + 8 <= samples; i += 8) {
+        __m128i lo = _mm_cvtps_epi32(_mm_loadu_ps(in + i));
+        __m128i hi = _mm_cvtps_epi32(_mm_loadu_ps(in + i + 4));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(lo, hi));
+    }
+#elif PPSSPP_ARCH(ARM64)
+    for (; i + 8 <= samples; i += 8) {
+        int32x4_t lo = vcvtnq_s32_f32(vld1q_f32(in + i));
+        int32x4_t hi = vcvtnq_s32_f32(vld1q_f32(in + i + 4));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+#endif
+    for (; i < samples; i++) {
+        float s = std::max(-32768.0f, std::min(32767.0f, in[i]));
+        out[i] = (int16_t)lrintf(s);
+    }
+}
+
+size_t AudioResampler::Process(const int16_t *input, size_t inputFrames, int16_t *output, size_t maxOutputFrames) {
+    size_t base = left_.size();
+    left_.resize(base + inputFrames);
+    right_.resize(base + inputFrames);
+    float *left = &left_[0];
+    float *right = &right_[0];
+
+    size_t i = 0;
+#if PPSSPP_ARCH(SSE2)
+    for (; i + 4 <= inputFrames; i += 4) {
+        // Four interleaved frames, sign extend to 32 bits and split the channels.
+        __m128i s = _mm_loadu_si128((const __m128i *)(input + i * 2));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        __m128 a = _mm_cvtepi32_ps(lo);
+        __m128 b = _mm_cvtepi32_ps(hi);
+        _mm_storeu_ps(left + base + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + base + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#elif PPSSPP_ARCH(ARM_NEON)
+    for (; i + 4 <= inputFrames; i += 4) {
+        int16x4x2_t s = vld2_s16(input + i * 2);
+        vst1q_f32(left + base + i, vcvtq_f32_s32(vmovl_s16(s.val[0])));
+        vst1q_f32(right + base + i, vcvtq_f32_s32(vmovl_s16(s.val[1])));
+    }
+#endif
+    for (; i < inputFrames; i++) {
+        left[base + i] = input[i * 2];
+        right[base + i] = input[i * 2 + 1];
+    }
+
+    const int half = taps_ / 2;
+    const size_t available = left_.size();
+    scratch_.resize(maxOutputFrames * 2);
+    float *out = &scratch_[0];
+
+    size_t produced = 0;
+    while (produced < maxOutputFrames) {
+        size_t index = (size_t)pos_;
+        if (index + half >= available)
+            break;
+        float frac = (float)(pos_ - index);
+
+        if (quality_ == Quality::SINC) {
+            int phase = std::min((int)(frac * SINC_PHASES), SINC_PHASES - 1);
+            const float *row = &coeffs_[phase * SINC_TAPS];
+            size_t start = index - (half - 1);
+            out[produced * 2] = Dot16(left + start, row);
+            out[produced * 2 + 1] = Dot16(right + start, row);
+        } else {
+            out[produced * 2] = left[index] + (left[index + 1] - left[index]) * frac;
+            out[produced * 2 + 1] = right[index] + (right[index + 1] - right[index]) * frac;
+        }
+
+        produced++;
+        pos_ += step_;
+    }
+
+    ConvertToS16(out, output, produced * 2);
+
+    // Drop everything the filter won't look at again.
+    size_t drop = std::min((size_t)pos_ - (half - 1), available);
+    left_.erase(left_.begin(), left_.begin() + drop);
+    right_.erase(right_.begin(), right_.begin() + drop);
+    pos_ -= drop;
+
+    return produced;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Converts the interleaved stereo s16 output of __AudioMix to the host rate.
+// Keeps its own history between calls, so input can arrive in arbitrary chunks.
+class AudioResampler {
+public:
+    enum class Quality {
+        LINEAR,
+        SINC,  // 16 tap Blackman windowed sinc, 256 phases
+    };
+
+    AudioResampler(int inputRate, int outputRate, Quality quality);
+
+    // Multiplies the output / input ratio, used to keep a buffer at its target depth.
+    // Clamped to +-1%, which is well below what anyone can hear as a pitch change.
+    void SetRateCorrection(double correction);
+
+    // Roughly how many output frames Process will produce for inputFrames.
+    size_t OutputFramesFor(size_t inputFrames) const;
+
+    // Consumes all of input, returns the number of frames written to output.
+    size_t Process(const int16_t *input, size_t inputFrames, int16_t *output, size_t maxOutputFrames);
+
+    void Reset();
+
+    Quality GetQuality() const { return quality_; }
+
+private:
+    static const int SINC_TAPS = 16;
+    static const int SINC_PHASES = 256;
+
+    void BuildSincTable();
+
+    int inputRate_;
+    int outputRate_;
+    Quality quality_;
+    int taps_;
+    double step_;  // Input frames per output frame.
+    double pos_;   // Position in history_, in input frames.
+
+    // Deinterleaved so the filter can run straight down contiguous memory.
+    std::vector<float> left_;
+    std::vector<float> right_;
+    std::vector<float> coeffs_;
+    std::vector<float> scratch_;
+};
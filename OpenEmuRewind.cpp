@@ -0,0 +1,254 @@
+#include "OpenEmuRewind.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "zstd/lib/zstd.h"
+
+#include "Common/Log.h"
+#include "Common/TimeUtil.h"
+#include "Core/SaveState.h"
+
+#include "OpenEmuFastForward.h"
+
+namespace OpenEmuRewind {
+    struct Delta {
+        // Turns the next newer snapshot into this one, see XorDelta.
+        std::vector<uint8_t> compressed;
+        uint32_t size;
+        uint64_t frame;
+    };
+
+    static std::atomic<int> interval(0);
+    static std::atomic<size_t> budget(0);
+
+    // Emu thread only. Emulated frames, fast-forward runs several per boundary.
+    static uint64_t frame = 0;
+    static uint64_t lastEmulated = 0;
+    static uint64_t nextCapture = 0;
+
+    static std::vector<uint8_t> newest;
+    static uint64_t newestFrame = 0;
+    static std::deque<Delta> deltas;
+    static size_t deltaBytes = 0;
+
+    static std::vector<uint8_t> scratch;
+    static std::vector<uint8_t> xorBuffer;
+    static ZSTD_CCtx *cctx = nullptr;
+
+    static std::atomic<int> pendingStepBack(0);
+    static std::atomic<bool> clearRequested(false);
+
+    // Written by the emu thread, read from anywhere.
+    static std::mutex statsLock;
+    static Stats stats;
+
+    // delta = older ^ newer over the common length, plus the tail of older verbatim.
+    // Applying the same to newer gives older back.
+    static void XorDelta(const std::vector<uint8_t> &older, const std::vector<uint8_t> &newer, std::vector<uint8_t> &out) {
+        out.resize(older.size());
+        size_t common = std::min(older.size(), newer.size());
+        size_t i = 0;
+        for (; i + 8 <= common; i += 8) {
+            uint64_t a, b;
+            memcpy(&a, &older[i], 8);
+            memcpy(&b, &newer[i], 8);
+            a ^= b;
+            memcpy(&out[i], &a, 8);
+        }
+        for (; i < common; i++)
+            out[i] = older[i] ^ newer[i];
+        if (older.size() > common)
+            memcpy(&out[common], &older[common], older.size() - common);
+    }
+
+    static void ApplyDelta(const std::vector<uint8_t> &newer, const std::vector<uint8_t> &delta, std::vector<uint8_t> &out) {
+        // Same operation, with newer and delta swapped around.
+        XorDelta(delta, newer, out);
+    }
+
+    static void FreeAll() {
+        newest.clear();
+        newest.shrink_to_fit();
+        deltas.clear();
+        deltaBytes = 0;
+        scratch.clear();
+        scratch.shrink_to_fit();
+        xorBuffer.clear();
+        xorBuffer.shrink_to_fit();
+    }
+
+    static void UpdateStats(double captureMs) {
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.intervalFrames = interval;
+        stats.snapshots = (uint32_t)deltas.size() + (newest.empty() ? 0 : 1);
+        stats.memoryBytes = deltaBytes + newest.size();
+        stats.budgetBytes = budget;
+        stats.fullStateBytes = (uint32_t)newest.size();
+        stats.averageSnapshotBytes = deltas.empty() ? 0.0 : (double)deltaBytes / deltas.size();
+        if (captureMs >= 0.0) {
+            stats.lastCaptureMs = captureMs;
+            double perFrame = interval > 0 ? captureMs / interval : 0.0;
+            stats.captureCostPerFrameMs = stats.captureCostPerFrameMs == 0.0 ? perFrame : stats.captureCostPerFrameMs * 0.9 + perFrame * 0.1;
+        }
+    }
+
+    void Configure(int intervalFrames, size_t budgetBytes) {
+        // Resizing happens on the emu thread at the next boundary.
+        {
+            std::lock_guard<std::mutex> guard(statsLock);
+            interval = std::max(0, intervalFrames);
+            budget = budgetBytes;
+            stats = Stats();
+        }
+        clearRequested = true;
+    }
+
+    void SetBudget(size_t budgetBytes) {
+        budget = budgetBytes;
+    }
+
+    void Clear() {
+        clearRequested = true;
+    }
+
+    bool RequestStepBack(int frames) {
+        if (interval <= 0 || frames <= 0)
+            return false;
+        pendingStepBack += frames;
+        return true;
+    }
+
+    // Oldest first. Returns whether anything was dropped.
+    static bool DropOverBudget() {
+        bool dropped = false;
+        while (!deltas.empty() && deltaBytes + newest.size() > budget) {
+            deltaBytes -= deltas.front().compressed.size();
+            deltas.pop_front();
+            dropped = true;
+        }
+        return dropped;
+    }
+
+    static void Capture() {
+        double start = time_now_d();
+
+        if (SaveState::SaveToRam(scratch) != CChunkFileReader::ERROR_NONE) {
+            WARN_LOG(SAVESTATE, "Rewind: failed to capture state at frame %llu", (unsigned long long)frame);
+            return;
+        }
+
+        if (!newest.empty()) {
+            XorDelta(newest, scratch, xorBuffer);
+
+            if (!cctx)
+                cctx = ZSTD_createCCtx();
+            Delta delta;
+            delta.compressed.resize(ZSTD_compressBound(xorBuffer.size()));
+            size_t size = ZSTD_compressCCtx(cctx, &delta.compressed[0], delta.compressed.size(), &xorBuffer[0], xorBuffer.size(), 1);
+            if (ZSTD_isError(size)) {
+                WARN_LOG(SAVESTATE, "Rewind: compression failed: %s", ZSTD_getErrorName(size));
+                return;
+            }
+            delta.compressed.resize(size);
+            delta.compressed.shrink_to_fit();
+            delta.size = (uint32_t)xorBuffer.size();
+            delta.frame = newestFrame;
+
+            deltaBytes += size;
+            deltas.push_back(std::move(delta));
+        }
+
+        newest.swap(scratch);
+        newestFrame = frame;
+        DropOverBudget();
+
+        UpdateStats((time_now_d() - start) * 1000.0);
+    }
+
+    static void StepBack(int frames) {
+        if (newest.empty())
+            return;
+        double start = time_now_d();
+
+        uint64_t target = frame > (uint64_t)frames ? frame - frames : 0;
+
+        // Peel deltas off the newest end until we're at or before the target frame.
+        while (newestFrame > target && !deltas.empty()) {
+            Delta &delta = deltas.back();
+            xorBuffer.resize(delta.size);
+            size_t size = ZSTD_decompress(&xorBuffer[0], xorBuffer.size(), &delta.compressed[0], delta.compressed.size());
+            if (ZSTD_isError(size) || size != delta.size) {
+                ERROR_LOG(SAVESTATE, "Rewind: corrupt snapshot for frame %llu, dropping history", (unsigned long long)delta.frame);
+                deltas.clear();
+                deltaBytes = 0;
+                break;
+            }
+
+            ApplyDelta(newest, xorBuffer, scratch);
+            newest.swap(scratch);
+            newestFrame = delta.frame;
+            deltaBytes -= delta.compressed.size();
+            deltas.pop_back();
+        }
+
+        std::string error;
+        // LoadFromRam may consume the buffer, keep our copy of the newest state.
+        scratch = newest;
+        if (SaveState::LoadFromRam(scratch, &error) != CChunkFileReader::ERROR_NONE) {
+            ERROR_LOG(SAVESTATE, "Rewind: failed to load snapshot for frame %llu: %s", (unsigned long long)newestFrame, error.c_str());
+            return;
+        }
+
+        uint32_t stepped = (uint32_t)(frame - newestFrame);
+        INFO_LOG(SAVESTATE, "Rewind: stepped back %u frames to frame %llu", stepped, (unsigned long long)newestFrame);
+        frame = newestFrame;
+        {
+            std::lock_guard<std::mutex> guard(statsLock);
+            stats.stepBacks++;
+            stats.lastStepBackFrames = stepped;
+            stats.lastStepBackMs = (time_now_d() - start) * 1000.0;
+        }
+        UpdateStats(-1.0);
+    }
+
+    void OnFrameBoundary() {
+        uint64_t emulated = OpenEmuFastForward::GetStats().emulatedFrames;
+        frame += emulated - lastEmulated;
+        lastEmulated = emulated;
+
+        if (clearRequested.exchange(false)) {
+            FreeAll();
+            nextCapture = frame;
+            UpdateStats(-1.0);
+        }
+        if (interval <= 0)
+            return;
+        // The budget may have shrunk since the last capture.
+        if (DropOverBudget())
+            UpdateStats(-1.0);
+
+        int stepBack = pendingStepBack.exchange(0);
+        if (stepBack > 0) {
+            StepBack(stepBack);
+            // The restored state is the snapshot at `frame`, so don't capture it again.
+            nextCapture = frame + interval;
+            return;
+        }
+
+        if (frame >= nextCapture) {
+            Capture();
+            nextCapture = frame + interval;
+        }
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(statsLock);
+        return stats;
+    }
+} // namespace OpenEmuRewind
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// In-memory rewind. Every K emulated frames the emu thread serializes the core into RAM. The newest
+// snapshot is kept as is, every older one only as a zstd compressed XOR against its successor,
+// so going back is a walk from the newest snapshot towards the oldest. The oldest snapshots
+// are dropped whenever the total goes over the memory budget.
+namespace OpenEmuRewind {
+    struct Stats {
+        uint32_t intervalFrames;
+        uint32_t snapshots;
+        uint64_t memoryBytes;
+        uint64_t budgetBytes;
+        // Serialize + delta + compress of the most recent capture.
+        double lastCaptureMs;
+        // Average capture time spread over the frames between captures.
+        double captureCostPerFrameMs;
+        // Average compressed delta size.
+        double averageSnapshotBytes;
+        uint32_t fullStateBytes;
+        uint64_t stepBacks;
+        // Where the last step back actually landed, and how long decoding and loading took.
+        uint32_t lastStepBackFrames;
+        double lastStepBackMs;
+    };
+
+    // intervalFrames = 0 disables rewind and frees all snapshots.
+    void Configure(int intervalFrames, size_t budgetBytes);
+    // Keeps the snapshots, the oldest go at the next frame boundary if they no longer fit.
+    void SetBudget(size_t budgetBytes);
+    void Clear();
+
+    // Any thread. The step back happens on the emu thread at the next frame boundary,
+    // rounded to the nearest snapshot at or before the requested frame.
+    bool RequestStepBack(int frames);
+
+    // Emu thread, at the host frame boundary. Counts the frames emulated since the last
+    // one through OpenEmuFastForward, so intervals stay in emulated frames while
+    // fast-forwarding. Applies a pending step back, otherwise captures a snapshot when due.
+    void OnFrameBoundary();
+
+    Stats GetStats();
+} // namespace OpenEmuRewind
@@ -0,0 +1,112 @@
+#include "OpenEmuRunAhead.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Common/Log.h"
+#include "Common/TimeUtil.h"
+#include "Core/Config.h"
+#include "Core/SaveState.h"
+#include "Core/System.h"
+#include "GPU/GPUState.h"
+
+namespace OpenEmuRunAhead {
+    static std::atomic<int> runAheadFrames(0);
+
+    // Emu thread only.
+    static std::vector<uint8_t> snapshot;
+
+    static std::mutex statsLock;
+    static Stats stats;
+
+    static void Average(double &value, double sample) {
+        value = value == 0.0 ? sample : value * 0.95 + sample * 0.05;
+    }
+
+    void SetFrames(int frames) {
+        runAheadFrames = std::max(0, std::min(frames, MAX_FRAMES));
+    }
+
+    int GetFrames() {
+        return runAheadFrames;
+    }
+
+    // Speculative frames don't draw, don't push audio into the mixer and don't wait for the
+    // frame limiter.
+    static void RunSpeculative(void (*runCoreFrame)(), bool present) {
+        bool enableSound = g_Config.bEnableSound;
+        bool fastForward = PSP_CoreParameter().fastForward;
+
+        g_Config.bEnableSound = false;
+        PSP_CoreParameter().fastForward = true;
+        if (present)
+            gstate_c.skipDrawReason &= ~SKIPDRAW_SKIPFRAME;
+        else
+            gstate_c.skipDrawReason |= SKIPDRAW_SKIPFRAME;
+
+        runCoreFrame();
+
+        g_Config.bEnableSound = enableSound;
+        PSP_CoreParameter().fastForward = fastForward;
+    }
+
+    void RunFrame(void (*runCoreFrame)(), void (*afterRealFrame)()) {
+        int frames = runAheadFrames;
+        if (frames == 0) {
+            if (snapshot.capacity() != 0) {
+                // Switched off, the snapshot is a full state's worth of memory.
+                std::vector<uint8_t>().swap(snapshot);
+                std::lock_guard<std::mutex> guard(statsLock);
+                stats.snapshotBytes = 0;
+            }
+            runCoreFrame();
+            afterRealFrame();
+            return;
+        }
+
+        // What the real frame draws is never shown, the last speculative frame replaces it.
+        double start = time_now_d();
+        gstate_c.skipDrawReason |= SKIPDRAW_SKIPFRAME;
+        runCoreFrame();
+        afterRealFrame();
+        double realEnd = time_now_d();
+
+        if (SaveState::SaveToRam(snapshot) != CChunkFileReader::ERROR_NONE) {
+            std::lock_guard<std::mutex> guard(statsLock);
+            stats.failedSnapshots++;
+            return;
+        }
+        double snapshotEnd = time_now_d();
+
+        for (int i = 0; i < frames; i++)
+            RunSpeculative(runCoreFrame, i == frames - 1);
+        double speculativeEnd = time_now_d();
+
+        std::string error;
+        if (SaveState::LoadFromRam(snapshot, &error) != CChunkFileReader::ERROR_NONE) {
+            // Now we're actually N frames ahead. Not much to do but carry on from here.
+            ERROR_LOG(SAVESTATE, "Run-ahead: rollback failed, disabling: %s", error.c_str());
+            runAheadFrames = 0;
+        }
+        double end = time_now_d();
+
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.frames = frames;
+        Average(stats.realFrameMs, (realEnd - start) * 1000.0);
+        Average(stats.snapshotMs, (snapshotEnd - realEnd) * 1000.0);
+        Average(stats.speculativeFrameMs, (speculativeEnd - snapshotEnd) * 1000.0 / frames);
+        Average(stats.rollbackMs, (end - speculativeEnd) * 1000.0);
+        Average(stats.extraMs, (end - realEnd) * 1000.0);
+        stats.snapshotBytes = snapshot.capacity();
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(statsLock);
+        Stats result = stats;
+        result.frames = runAheadFrames;
+        return result;
+    }
+} // namespace OpenEmuRunAhead
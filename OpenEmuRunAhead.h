@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+// Run-ahead input latency reduction. Each host frame runs the real emulated frame, snapshots
+// the core, runs N more frames with the input of the real one, presents the last of them and
+// rolls back to the snapshot. Games that take a few frames to react to input then show the
+// reaction N frames earlier, at the cost of emulating N + 1 frames per host frame.
+//
+// Rolling back reloads GPU state, so titles that rely on framebuffer contents surviving from
+// one frame to the next may glitch with it on. It's meant to be enabled per title.
+namespace OpenEmuRunAhead {
+    static const int MAX_FRAMES = 4;
+
+    struct Stats {
+        int frames;
+        // Averages over recent host frames.
+        double realFrameMs;
+        double snapshotMs;
+        double speculativeFrameMs;  // Per speculative frame.
+        double rollbackMs;
+        // Everything run-ahead adds on top of the real frame, per host frame.
+        double extraMs;
+        uint64_t failedSnapshots;
+        uint64_t snapshotBytes;
+    };
+
+    // 0 turns it off.
+    void SetFrames(int frames);
+    int GetFrames();
+
+    // Emu thread, inside the host frame. Runs the real frame through runCoreFrame, then
+    // afterRealFrame (where the real frame's audio gets mixed), then the speculative frames.
+    void RunFrame(void (*runCoreFrame)(), void (*afterRealFrame)());
+
+    Stats GetStats();
+} // namespace OpenEmuRunAhead
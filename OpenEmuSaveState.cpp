@@ -0,0 +1,160 @@
+#include "OpenEmuSaveState.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Common/Log.h"
+#include "Common/Serialize/Serializer.h"
+#include "Common/Thread/ThreadManager.h"
+#include "Common/TimeUtil.h"
+#include "Core/ELF/ParamSFO.h"
+#include "Core/SaveState.h"
+#include "Core/System.h"
+
+#include "OpenEmuCoreThread.h"
+
+extern const char *PPSSPP_GIT_VERSION;
+
+namespace OpenEmuSaveState {
+    struct Request {
+        Path filename;
+        Callback callback;
+    };
+
+    // Guards everything below. pendingWrites counts saves taken off the queue until their
+    // file is written.
+    static std::mutex pendingLock;
+    static std::condition_variable pendingCond;
+    static std::deque<Request> requests;
+    static int pendingWrites = 0;
+
+    class SaveStateWriteTask : public Task {
+    public:
+        SaveStateWriteTask(const Path &filename, std::vector<u8> &&state, const Timing &timing, Callback callback)
+            : filename_(filename), state_(std::move(state)), timing_(timing), callback_(callback) {}
+
+        TaskType Type() const override { return TaskType::IO_BLOCKING; }
+        TaskPriority Priority() const override { return TaskPriority::NORMAL; }
+
+        void Run() override {
+            double start = time_now_d();
+            // SaveFile compresses and takes ownership of the buffer, same as SaveState::Save.
+            size_t size = state_.size();
+            u8 *data = new u8[size];
+            memcpy(data, &state_[0], size);
+            std::vector<u8>().swap(state_);
+            CChunkFileReader::Error result = CChunkFileReader::SaveFile(filename_, g_paramSFO.GetValueString("TITLE"), PPSSPP_GIT_VERSION, data, size);
+            timing_.writeMs = (time_now_d() - start) * 1000.0;
+
+            bool success = result == CChunkFileReader::ERROR_NONE;
+            if (success) {
+                INFO_LOG(SAVESTATE, "Saved %s: paused %.2f ms, wrote %zu bytes in the background in %.2f ms", filename_.c_str(), timing_.pauseMs, size, timing_.writeMs);
+            } else {
+                ERROR_LOG(SAVESTATE, "Failed to write save state %s", filename_.c_str());
+            }
+
+            if (callback_)
+                callback_(success, timing_);
+
+            std::lock_guard<std::mutex> guard(pendingLock);
+            pendingWrites--;
+            pendingCond.notify_all();
+        }
+
+    private:
+        Path filename_;
+        std::vector<u8> state_;
+        Timing timing_;
+        Callback callback_;
+    };
+
+    // With the core between frames, either on the emu thread or with it paused. The
+    // request was already counted in pendingWrites.
+    static void Serialize(const Request &request) {
+        Timing timing{};
+        std::vector<u8> state;
+        double start = time_now_d();
+        CChunkFileReader::Error result = PSP_IsInited() ? SaveState::SaveToRam(state) : CChunkFileReader::ERROR_BAD_FILE;
+        timing.pauseMs = (time_now_d() - start) * 1000.0;
+        timing.stateBytes = state.size();
+
+        if (result != CChunkFileReader::ERROR_NONE || state.empty()) {
+            ERROR_LOG(SAVESTATE, "Failed to serialize save state for %s", request.filename.c_str());
+            if (request.callback)
+                request.callback(false, timing);
+            std::lock_guard<std::mutex> guard(pendingLock);
+            pendingWrites--;
+            pendingCond.notify_all();
+            return;
+        }
+
+        g_threadManager.EnqueueTask(new SaveStateWriteTask(request.filename, std::move(state), timing, request.callback));
+    }
+
+    // Takes the oldest request off the queue once the previous write is done, so two
+    // writes to the same file can't race each other.
+    static bool TakeRequest(Request *request, bool wait) {
+        std::unique_lock<std::mutex> lock(pendingLock);
+        if (wait)
+            pendingCond.wait(lock, [] { return pendingWrites == 0; });
+        if (requests.empty() || pendingWrites != 0)
+            return false;
+        *request = std::move(requests.front());
+        requests.pop_front();
+        pendingWrites++;
+        return true;
+    }
+
+    // Everything the emu thread hasn't got to yet, on this thread with the emu thread
+    // paused. Only has to wait for writes when more than one save was queued.
+    static void SerializeQueued() {
+        {
+            std::lock_guard<std::mutex> guard(pendingLock);
+            if (requests.empty())
+                return;
+        }
+
+        bool wasRunning = OpenEmuCoreThread::GetState() == OpenEmuCoreThread::EmuThreadState::RUNNING;
+        if (wasRunning)
+            NativeSetThreadState(OpenEmuCoreThread::EmuThreadState::PAUSE_REQUESTED);
+        Request request;
+        while (TakeRequest(&request, true))
+            Serialize(request);
+        if (wasRunning)
+            NativeSetThreadState(OpenEmuCoreThread::EmuThreadState::START_REQUESTED);
+    }
+
+    void SaveAsync(const Path &filename, Callback callback) {
+        if (!PSP_IsInited()) {
+            if (callback)
+                callback(false, Timing{});
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(pendingLock);
+            requests.push_back(Request{ filename, callback });
+        }
+
+        // A paused emu thread doesn't reach a frame boundary, but it also isn't touching
+        // the core, so that's as good as one.
+        if (OpenEmuCoreThread::GetState() != OpenEmuCoreThread::EmuThreadState::RUNNING)
+            SerializeQueued();
+    }
+
+    void OnFrameBoundary() {
+        Request request;
+        if (TakeRequest(&request, false))
+            Serialize(request);
+    }
+
+    void WaitForPendingWrites() {
+        SerializeQueued();
+        std::unique_lock<std::mutex> lock(pendingLock);
+        pendingCond.wait(lock, [] { return pendingWrites == 0; });
+    }
+} // namespace OpenEmuSaveState
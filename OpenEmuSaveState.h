@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+#include "Common/File/Path.h"
+
+// Save states without a long pause. The emu thread serializes the core into memory at its
+// next frame boundary with SaveState::SaveToRam, the same spot rewind captures from;
+// compressing and writing the file happen on a g_threadManager worker while emulation
+// already continues.
+namespace OpenEmuSaveState {
+    struct Timing {
+        // How long emulation was held up for serializing.
+        double pauseMs;
+        // Compression and file write on the worker.
+        double writeMs;
+        size_t stateBytes;
+    };
+
+    typedef std::function<void(bool success, const Timing &timing)> Callback;
+
+    // Call from the thread that drives NativeRender. Doesn't wait for the emu thread, with
+    // it paused the state is serialized right here. The callback runs on the worker thread
+    // once the file is complete.
+    void SaveAsync(const Path &filename, Callback callback);
+
+    // Emu thread, between frames. Serializes the oldest requested save.
+    void OnFrameBoundary();
+
+    // Blocks until all saves requested by SaveAsync are on disk, e.g. before loading a
+    // state or shutting down. Call from the thread that drives NativeRender, saves the emu
+    // thread hasn't got to yet are serialized here with it paused.
+    void WaitForPendingWrites();
+} // namespace OpenEmuSaveState
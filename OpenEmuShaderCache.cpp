@@ -0,0 +1,186 @@
+#include "OpenEmuShaderCache.h"
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Common/File/FileUtil.h"
+#include "Common/Log.h"
+#include "Core/Config.h"
+#include "Core/ELF/ParamSFO.h"
+#include "GPU/GPU.h"
+#include "GPU/GPUInterface.h"
+
+#include "OpenEmuPerfCounters.h"
+
+namespace OpenEmuShaderCache {
+    static const DebugShaderType trackedTypes[] = { SHADER_TYPE_VERTEX, SHADER_TYPE_FRAGMENT };
+    static const int NUM_TRACKED = sizeof(trackedTypes) / sizeof(trackedTypes[0]);
+
+    static Path listFile;
+    // Every variant any session of this game has used, "<type> <id>" per entry.
+    static std::set<std::string> known;
+    static bool knownChanged = false;
+    // Variants the GPU had at the end of the last frame, to spot new ones.
+    static std::set<std::string> live[NUM_TRACKED];
+    // Until PPSSPP's precompile from its cache finished, what shows up isn't counted.
+    static bool precompileDone = false;
+
+    static std::atomic<bool> enabled(false);
+
+    // Frames the emu thread saw compiles in, waiting for their host thread time.
+    static std::atomic<int> pendingCompileFrames(0);
+
+    static std::mutex statsLock;
+    static Stats stats;
+
+    void Configure() {
+        // On by default in PPSSPP, but an old ini can have it off.
+        g_Config.bShaderCache = true;
+    }
+
+    void SetEnabled(bool enable) {
+        enabled = enable;
+    }
+
+    bool IsEnabled() {
+        return enabled || OpenEmuPerfCounters::IsEnabled();
+    }
+
+    void OnGameStarted() {
+        known.clear();
+        knownChanged = false;
+        for (int i = 0; i < NUM_TRACKED; i++)
+            live[i].clear();
+        precompileDone = false;
+        pendingCompileFrames = 0;
+
+        std::string discID = g_paramSFO.GetDiscID();
+        if (discID.empty()) {
+            listFile = Path();
+            return;
+        }
+        listFile = g_Config.appCacheDirectory / (discID + ".oeshaderids");
+
+        FILE *file = File::OpenCFile(listFile, "r");
+        if (!file)
+            return;
+        char line[512];
+        while (fgets(line, sizeof(line), file)) {
+            std::string entry(line);
+            while (!entry.empty() && (entry.back() == '\n' || entry.back() == '\r'))
+                entry.pop_back();
+            if (!entry.empty())
+                known.insert(entry);
+        }
+        fclose(file);
+        INFO_LOG(G3D, "%zu known shader variants for %s", known.size(), discID.c_str());
+    }
+
+    void OnGameStopped() {
+        if (!knownChanged || listFile.empty())
+            return;
+
+        File::CreateFullPath(listFile.NavigateUp());
+        FILE *file = File::OpenCFile(listFile, "w");
+        if (!file) {
+            WARN_LOG(G3D, "Can't write %s", listFile.c_str());
+            return;
+        }
+        for (const std::string &entry : known)
+            fprintf(file, "%s\n", entry.c_str());
+        fclose(file);
+        knownChanged = false;
+    }
+
+    void EndFrame() {
+        if (!gpu || !IsEnabled())
+            return;
+
+        // Everything the precompile loaded is there whether the game uses it or not, it
+        // isn't a hit. Only what gets compiled after that counts.
+        bool counting = precompileDone;
+        int hits = 0;
+        int misses = 0;
+        size_t precompiled = 0;
+        for (int i = 0; i < NUM_TRACKED; i++) {
+            std::vector<std::string> list = gpu->DebugGetShaderIDs(trackedTypes[i]);
+            std::set<std::string> ids(list.begin(), list.end());
+
+            // Not just the count, a variant can be replaced by another within a frame.
+            for (const std::string &id : ids) {
+                if (live[i].count(id))
+                    continue;
+                std::string entry = std::to_string((int)trackedTypes[i]) + " " + id;
+                bool isNew = known.insert(entry).second;
+                knownChanged = knownChanged || isNew;
+                if (!counting)
+                    continue;
+                if (isNew)
+                    misses++;
+                else
+                    hits++;
+            }
+
+            // Whatever the GPU dropped (device lost, clear) counts again when it comes back.
+            live[i].swap(ids);
+            precompiled += live[i].size();
+        }
+
+        if (!counting) {
+            if (!GPU_IsStarted())
+                return;
+            precompileDone = true;
+            std::lock_guard<std::mutex> guard(statsLock);
+            stats.precompiled = precompiled;
+            return;
+        }
+
+        if (hits == 0 && misses == 0)
+            return;
+
+        if (OpenEmuPerfCounters::IsEnabled()) {
+            OpenEmuPerfCounters::Count(OpenEmuPerfCounters::Event::SHADER_HIT, hits);
+            OpenEmuPerfCounters::Count(OpenEmuPerfCounters::Event::SHADER_MISS, misses);
+        }
+
+        pendingCompileFrames++;
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.hits += hits;
+        stats.misses += misses;
+        stats.compileFrames++;
+        stats.lastFrameHits = hits;
+        stats.lastFrameMisses = misses;
+        stats.lastFrameCompileMs = 0.0;
+    }
+
+    void RecordHostFrame(double ms) {
+        // The GL work for a frame the emu thread saw compiles in runs in the next ThreadFrame.
+        int pending = pendingCompileFrames.load(std::memory_order_relaxed);
+        if (pending == 0 || !pendingCompileFrames.compare_exchange_strong(pending, pending - 1))
+            return;
+
+        if (OpenEmuPerfCounters::IsEnabled())
+            OpenEmuPerfCounters::Add(OpenEmuPerfCounters::Counter::SHADER_COMPILE, (uint64_t)(ms * 1e6));
+        std::lock_guard<std::mutex> guard(statsLock);
+        stats.compileMs += ms;
+        stats.lastFrameCompileMs = ms;
+        if (ms > stats.maxCompileFrameMs)
+            stats.maxCompileFrameMs = ms;
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(statsLock);
+        return stats;
+    }
+
+    void ResetStats() {
+        std::lock_guard<std::mutex> guard(statsLock);
+        size_t precompiled = stats.precompiled;
+        stats = Stats();
+        stats.precompiled = precompiled;
+    }
+} // namespace OpenEmuShaderCache
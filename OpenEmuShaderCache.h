@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+// PPSSPP's GL backend keeps a per game cache of the shader and program variants it has
+// compiled (<discID>.glshadercache in appCacheDirectory). It reloads it when the GPU is
+// created and compiles the entries in slices from BeginHostFrame, so they're ready before
+// the game asks for them. This makes sure that cache is on, and tells cache precompiles
+// apart from first-encounter compiles (the ones that stutter).
+//
+// For that it keeps its own list of every variant id a game has ever used, next to
+// PPSSPP's cache. Whatever the GPU has once its precompile finished came from the cache
+// and is only counted as precompiled. A variant compiled after that which is on the list
+// could have been precompiled (a hit, PPSSPP's cache didn't have it), one that isn't is
+// new (a miss). Both stutter; with a warm cache they stay at zero. Tracking only runs
+// while it's enabled or the perf counters are, listing the variants every frame isn't
+// free. The perf counters get the per frame hits, misses and compile time too.
+namespace OpenEmuShaderCache {
+    struct Stats {
+        // Variants the GPU had loaded from PPSSPP's cache by the end of its precompile.
+        uint64_t precompiled;
+        uint64_t hits;
+        uint64_t misses;
+        // Frames that compiled anything, and the host thread time they took. That includes
+        // the rest of the frame, so it's an upper bound on the compile cost.
+        uint64_t compileFrames;
+        double compileMs;
+        double maxCompileFrameMs;
+        // The last frame that compiled anything.
+        int lastFrameHits;
+        int lastFrameMisses;
+        double lastFrameCompileMs;
+    };
+
+    // After the config is loaded.
+    void Configure();
+
+    // Any thread.
+    void SetEnabled(bool enabled);
+    bool IsEnabled();
+
+    // Once PSP_Init is done and the disc id is known. Loads the variant list.
+    void OnGameStarted();
+    // Before PSP_Shutdown. Writes the variant list back if it grew.
+    void OnGameStopped();
+
+    // Emu thread, after EndHostFrame.
+    void EndFrame();
+    // Host thread, time spent in ThreadFrame.
+    void RecordHostFrame(double ms);
+
+    Stats GetStats();
+    void ResetStats();
+} // namespace OpenEmuShaderCache
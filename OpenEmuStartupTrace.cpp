@@ -0,0 +1,129 @@
+#include "OpenEmuStartupTrace.h"
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Common/Data/Format/JSONWriter.h"
+#include "Common/File/FileUtil.h"
+#include "Common/Log.h"
+#include "Common/Thread/ThreadManager.h"
+#include "Common/TimeUtil.h"
+
+namespace OpenEmuStartupTrace {
+    struct Step {
+        const char *name;
+        double start;
+        double end;
+        int thread;
+    };
+
+    static std::mutex lock;
+    static std::vector<Step> steps;
+    static Path traceFile;
+    static double beginTime = 0.0;
+    static std::atomic<bool> active(false);
+    static std::atomic<double> firstFrameMs(-1.0);
+
+    // Small stable numbers read better in the trace viewer than native thread ids.
+    static std::atomic<int> nextThread(1);
+
+    static int ThreadIndex() {
+        thread_local int index = nextThread++;
+        return index;
+    }
+
+    class TraceWriteTask : public Task {
+    public:
+        TraceWriteTask(const Path &filename, std::string &&json) : filename_(filename), json_(std::move(json)) {}
+
+        TaskType Type() const override { return TaskType::IO_BLOCKING; }
+        TaskPriority Priority() const override { return TaskPriority::LOW; }
+
+        void Run() override {
+            File::CreateFullPath(filename_.NavigateUp());
+            FILE *file = File::OpenCFile(filename_, "w");
+            if (!file) {
+                WARN_LOG(SYSTEM, "Can't write startup trace to %s", filename_.c_str());
+                return;
+            }
+            fwrite(json_.data(), 1, json_.size(), file);
+            fclose(file);
+        }
+
+    private:
+        Path filename_;
+        std::string json_;
+    };
+
+    void Begin() {
+        std::lock_guard<std::mutex> guard(lock);
+        steps.clear();
+        beginTime = time_now_d();
+        firstFrameMs = -1.0;
+        active = true;
+    }
+
+    void SetTraceFile(const Path &filename) {
+        std::lock_guard<std::mutex> guard(lock);
+        traceFile = filename;
+    }
+
+    void AddStep(const char *name, double start, double end) {
+        if (!active)
+            return;
+        std::lock_guard<std::mutex> guard(lock);
+        steps.push_back(Step{ name, start, end, ThreadIndex() });
+    }
+
+    ScopedStep::ScopedStep(const char *name) : name_(name), start_(time_now_d()) {}
+
+    ScopedStep::~ScopedStep() {
+        AddStep(name_, start_, time_now_d());
+    }
+
+    void FirstFrame() {
+        if (!active.load(std::memory_order_relaxed))
+            return;
+
+        double now = time_now_d();
+        std::lock_guard<std::mutex> guard(lock);
+        if (!active)
+            return;
+        active = false;
+
+        double total = (now - beginTime) * 1000.0;
+        firstFrameMs = total;
+        NOTICE_LOG(SYSTEM, "Startup: %.1f ms to first frame", total);
+        if (traceFile.empty())
+            return;
+
+        json::JsonWriter writer;
+        writer.begin();
+        writer.writeString("displayTimeUnit", "ms");
+        writer.writeFloat("timeToFirstFrameMs", total);
+        writer.pushArray("traceEvents");
+        steps.push_back(Step{ "Time to first frame", beginTime, now, 0 });
+        for (const Step &step : steps) {
+            writer.pushDict();
+            writer.writeString("name", step.name);
+            writer.writeString("ph", "X");
+            writer.writeInt("pid", 1);
+            writer.writeInt("tid", step.thread);
+            writer.writeFloat("ts", (step.start - beginTime) * 1e6);
+            writer.writeFloat("dur", (step.end - step.start) * 1e6);
+            writer.pop();
+        }
+        writer.pop();
+        writer.end();
+
+        // Off the render thread, this is called right after the first present.
+        g_threadManager.EnqueueTask(new TraceWriteTask(traceFile, writer.str()));
+    }
+
+    double TimeToFirstFrameMs() {
+        return firstFrameMs;
+    }
+} // namespace OpenEmuStartupTrace
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Common/File/Path.h"
+
+// Timeline of everything between the core being asked to load a game and the first frame
+// on screen. Steps can run on any thread. The first frame closes the timeline and writes
+// it out as a Chrome trace (chrome://tracing, Perfetto) if a file was set.
+namespace OpenEmuStartupTrace {
+    // Starts a new timeline, everything is relative to this.
+    void Begin();
+
+    void SetTraceFile(const Path &filename);
+
+    // Records a step from start to end, in time_now_d() seconds.
+    void AddStep(const char *name, double start, double end);
+
+    class ScopedStep {
+    public:
+        // name must outlive the timeline, a string literal.
+        explicit ScopedStep(const char *name);
+        ~ScopedStep();
+
+    private:
+        const char *name_;
+        double start_;
+    };
+
+    // Cheap after the first call, safe to call every frame.
+    void FirstFrame();
+
+    // Negative until FirstFrame.
+    double TimeToFirstFrameMs();
+} // namespace OpenEmuStartupTrace
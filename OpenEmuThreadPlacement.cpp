@@ -0,0 +1,288 @@
+#include "OpenEmuThreadPlacement.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+#include <pthread/qos.h>
+#include <unistd.h>
+#endif
+
+#include "Common/Log.h"
+
+namespace OpenEmuThreadPlacement {
+    // Without CAP_SYS_NICE raising fails, which is fine, lowering the workers still works.
+    static const int FOREGROUND_NICE = -5;
+    static const int WORKER_NICE = 5;
+
+    static std::mutex lock;
+    static Policy policy = Policy::OS;
+    static Plan plan;
+    static bool planned = false;
+
+    const char *PolicyName(Policy policy) {
+        switch (policy) {
+            case Policy::OS: return "os";
+            case Policy::PRIORITY: return "priority";
+            case Policy::PERFORMANCE: return "performance";
+        }
+        return "?";
+    }
+
+    bool ParsePolicy(const char *name, Policy *result) {
+        for (Policy candidate : { Policy::OS, Policy::PRIORITY, Policy::PERFORMANCE }) {
+            if (!strcmp(name, PolicyName(candidate))) {
+                *result = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+#if defined(__linux__)
+    struct Cpu {
+        int id;
+        int package;
+        int core;
+        long capacity;
+    };
+
+    static long ReadNumber(const std::string &path, long fallback) {
+        FILE *file = fopen(path.c_str(), "r");
+        if (!file)
+            return fallback;
+        long value = fallback;
+        if (fscanf(file, "%ld", &value) != 1)
+            value = fallback;
+        fclose(file);
+        return value;
+    }
+
+    // "0-3,6,8-9"
+    static std::vector<int> ReadCpuList(const char *path) {
+        std::vector<int> cpus;
+        FILE *file = fopen(path, "r");
+        if (!file)
+            return cpus;
+        int first, last;
+        while (fscanf(file, "%d", &first) == 1) {
+            last = first;
+            int c = fgetc(file);
+            if (c == '-') {
+                if (fscanf(file, "%d", &last) != 1)
+                    break;
+                c = fgetc(file);
+            }
+            for (int cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+            if (c != ',')
+                break;
+        }
+        fclose(file);
+        return cpus;
+    }
+
+    static Plan MakePlan(Policy policy) {
+        Plan result;
+        result.emuCpu = -1;
+        result.renderCpu = -1;
+
+        std::vector<Cpu> cpus;
+        for (int id : ReadCpuList("/sys/devices/system/cpu/online")) {
+            std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/";
+            Cpu cpu;
+            cpu.id = id;
+            cpu.package = (int)ReadNumber(dir + "topology/physical_package_id", 0);
+            cpu.core = (int)ReadNumber(dir + "topology/core_id", id);
+            // big.LITTLE reports capacity, x86 hybrid parts only differ in max frequency.
+            cpu.capacity = ReadNumber(dir + "cpu_capacity", ReadNumber(dir + "cpufreq/cpuinfo_max_freq", 0));
+            cpus.push_back(cpu);
+        }
+        result.logicalCpus = (int)cpus.size();
+
+        // SMT siblings share a (package, core) pair.
+        std::map<std::pair<int, int>, std::vector<int>> cores;
+        long maxCapacity = 0;
+        for (const Cpu &cpu : cpus) {
+            cores[std::make_pair(cpu.package, cpu.core)].push_back(cpu.id);
+            maxCapacity = std::max(maxCapacity, cpu.capacity);
+        }
+        result.physicalCores = (int)cores.size();
+
+        std::vector<std::vector<int>> performance;
+        for (const auto &core : cores) {
+            long capacity = 0;
+            for (const Cpu &cpu : cpus) {
+                if (cpu.id == core.second[0])
+                    capacity = cpu.capacity;
+            }
+            if (capacity * 100 >= maxCapacity * 95)
+                performance.push_back(core.second);
+        }
+        result.performanceCores = (int)performance.size();
+        if (policy != Policy::PERFORMANCE || performance.empty())
+            return result;
+
+        // From the end, interrupts tend to go to the first cores. Both on the last package
+        // so they share a last level cache.
+        const std::vector<int> &emuCore = performance.back();
+        result.emuCpu = emuCore[0];
+        const std::vector<int> *renderCore = nullptr;
+        if (performance.size() >= 2) {
+            renderCore = &performance[performance.size() - 2];
+            result.renderCpu = (*renderCore)[0];
+        }
+
+        for (const Cpu &cpu : cpus) {
+            bool reserved = std::find(emuCore.begin(), emuCore.end(), cpu.id) != emuCore.end();
+            if (renderCore)
+                reserved = reserved || std::find(renderCore->begin(), renderCore->end(), cpu.id) != renderCore->end();
+            if (!reserved)
+                result.workerCpus.push_back(cpu.id);
+        }
+        // Two cores or fewer, keeping the workers off them would leave them nowhere to run.
+        if (result.workerCpus.empty()) {
+            for (const Cpu &cpu : cpus) {
+                if (std::find(emuCore.begin(), emuCore.end(), cpu.id) == emuCore.end())
+                    result.workerCpus.push_back(cpu.id);
+            }
+        }
+        return result;
+    }
+
+    static void Pin(pid_t tid, const std::vector<int> &cpus) {
+        if (cpus.empty())
+            return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+            CPU_SET(cpu, &set);
+        if (sched_setaffinity(tid, sizeof(set), &set) != 0)
+            WARN_LOG(SYSTEM, "Can't pin thread %d: %s", (int)tid, strerror(errno));
+    }
+
+    static void Place(pid_t tid, Role role, Policy policy, const Plan &plan) {
+        if (policy == Policy::OS)
+            return;
+
+        if (policy == Policy::PERFORMANCE) {
+            if (role == Role::EMU && plan.emuCpu >= 0)
+                Pin(tid, { plan.emuCpu });
+            else if (role == Role::RENDER && plan.renderCpu >= 0)
+                Pin(tid, { plan.renderCpu });
+            else if (role == Role::WORKER)
+                Pin(tid, plan.workerCpus);
+        }
+
+        int nice = role == Role::WORKER ? WORKER_NICE : FOREGROUND_NICE;
+        if (setpriority(PRIO_PROCESS, tid, nice) != 0)
+            INFO_LOG(SYSTEM, "Can't set nice %d on thread %d: %s", nice, (int)tid, strerror(errno));
+    }
+#else
+    static Plan MakePlan(Policy policy) {
+        Plan result;
+        result.logicalCpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        result.physicalCores = result.logicalCpus;
+        result.performanceCores = result.logicalCpus;
+        result.emuCpu = -1;
+        result.renderCpu = -1;
+        return result;
+    }
+#endif
+
+    static const Plan &CurrentPlan() {
+        if (!planned) {
+            plan = MakePlan(policy);
+            planned = true;
+        }
+        return plan;
+    }
+
+    void SetPolicy(Policy newPolicy) {
+        std::lock_guard<std::mutex> guard(lock);
+        policy = newPolicy;
+        planned = false;
+        CurrentPlan();
+    }
+
+    Policy GetPolicy() {
+        std::lock_guard<std::mutex> guard(lock);
+        return policy;
+    }
+
+    Plan GetPlan() {
+        std::lock_guard<std::mutex> guard(lock);
+        return CurrentPlan();
+    }
+
+    std::string DescribePlan() {
+        Plan current = GetPlan();
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "%s, %d cpus, %d cores (%d performance), emu on %d, render on %d, workers on %d cpus",
+            PolicyName(GetPolicy()), current.logicalCpus, current.physicalCores, current.performanceCores, current.emuCpu, current.renderCpu,
+            current.workerCpus.empty() ? current.logicalCpus : (int)current.workerCpus.size());
+        return buffer;
+    }
+
+    void PlaceCurrentThread(Role role) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (policy == Policy::OS)
+            return;
+#if defined(__linux__)
+        Place((pid_t)syscall(SYS_gettid), role, policy, CurrentPlan());
+#elif defined(__APPLE__)
+        // On Apple silicon QoS is what picks performance or efficiency cores.
+        pthread_set_qos_class_self_np(role == Role::WORKER ? QOS_CLASS_UTILITY : QOS_CLASS_USER_INTERACTIVE, 0);
+        if (policy == Policy::PERFORMANCE) {
+            // Different tags ask the scheduler to keep the threads on different L2s. Only
+            // honoured on Intel, there's no pinning on macOS.
+            thread_affinity_policy_data_t affinity = { (integer_t)role + 1 };
+            mach_port_t thread = mach_thread_self();
+            thread_policy_set(thread, THREAD_AFFINITY_POLICY, (thread_policy_t)&affinity, THREAD_AFFINITY_POLICY_COUNT);
+            mach_port_deallocate(mach_task_self(), thread);
+        }
+#endif
+    }
+
+    void PlaceWorkers() {
+#if defined(__linux__)
+        std::lock_guard<std::mutex> guard(lock);
+        if (policy == Policy::OS)
+            return;
+
+        DIR *tasks = opendir("/proc/self/task");
+        if (!tasks)
+            return;
+        while (dirent *entry = readdir(tasks)) {
+            if (entry->d_name[0] == '.')
+                continue;
+            std::string comm = std::string("/proc/self/task/") + entry->d_name + "/comm";
+            char name[32] = {};
+            FILE *file = fopen(comm.c_str(), "r");
+            if (!file)
+                continue;
+            bool read = fgets(name, sizeof(name), file) != nullptr;
+            fclose(file);
+            // ThreadManager names them "PoolWorker N" and "PoolWorkerIO N".
+            if (read && !strncmp(name, "PoolWorker", 10))
+                Place((pid_t)atoi(entry->d_name), Role::WORKER, policy, CurrentPlan());
+        }
+        closedir(tasks);
+#endif
+        // Elsewhere a thread can only set its own QoS class, the workers keep the default.
+    }
+} // namespace OpenEmuThreadPlacement
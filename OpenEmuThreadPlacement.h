@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Where the emu thread, the render thread (OpenEmu's GL thread, which runs ThreadFrame)
+// and g_threadManager's workers run. Left to the OS they migrate between cores, and on
+// hybrid or big.LITTLE parts the emu thread can land on an efficiency core for a while.
+//
+// On Linux the topology comes from sysfs. Performance cores are the ones with the highest
+// cpu_capacity, or cpuinfo_max_freq where there's no capacity. Pinning uses
+// sched_setaffinity and priorities use nice values. macOS has no pinning, so there the
+// policies set the QoS class and affinity tags instead.
+namespace OpenEmuThreadPlacement {
+    enum class Policy {
+        // Leave everything to the OS.
+        OS,
+        // Raise the emu and render threads, lower the workers, no pinning.
+        PRIORITY,
+        // PRIORITY, plus emu and render each pinned to their own performance core with
+        // nothing on its SMT siblings, and workers confined to the other cores.
+        PERFORMANCE,
+    };
+
+    enum class Role {
+        EMU,
+        RENDER,
+        WORKER,
+    };
+
+    struct Plan {
+        int logicalCpus;
+        int physicalCores;
+        int performanceCores;
+        // -1 when not pinned.
+        int emuCpu;
+        int renderCpu;
+        // Empty when not confined.
+        std::vector<int> workerCpus;
+    };
+
+    const char *PolicyName(Policy policy);
+    bool ParsePolicy(const char *name, Policy *policy);
+
+    // Before any of the threads are placed, threads already placed keep their old placement.
+    void SetPolicy(Policy policy);
+    Policy GetPolicy();
+    Plan GetPlan();
+    std::string DescribePlan();
+
+    // From the thread being placed.
+    void PlaceCurrentThread(Role role);
+    // Places g_threadManager's workers, found by name. Safe to repeat, workers that hadn't
+    // named themselves yet get placed the next time.
+    void PlaceWorkers();
+} // namespace OpenEmuThreadPlacement
@@ -47,6 +47,7 @@
 
 #include "Common/GraphicsContext.h"
 #include "Common/LogManager.h"
+#include "Common/TimeUtil.h"
 #include "Common/Data/Text/I18n.h"
 
 #include "GPU/GPUInterface.h"
@@ -54,10 +55,35 @@
 #include "GLRenderManager.h"
 #include "DataFormatGL.h"
 
-#define AUDIO_FREQ          44100
+#include "OpenEmuAudio.h"
+#include "OpenEmuCoreThread.h"
+#include "OpenEmuDynamicResolution.h"
+#include "OpenEmuFastForward.h"
+#include "OpenEmuFileLoader.h"
+#include "OpenEmuFrameExport.h"
+#include "OpenEmuGeDump.h"
+#include "OpenEmuInflightFrames.h"
+#include "OpenEmuInput.h"
+#include "OpenEmuInputMovie.h"
+#include "OpenEmuJitCache.h"
+#include "OpenEmuMemory.h"
+#include "OpenEmuRewind.h"
+#include "OpenEmuRunAhead.h"
+#include "OpenEmuSaveState.h"
+#include "OpenEmuShaderCache.h"
+#include "OpenEmuStartupTrace.h"
+#include "OpenEmuThreadPlacement.h"
+
+// Host output rate. The core mixes at 44100 Hz and OpenEmuAudio resamples to this,
+// so nothing downstream has to resample again.
+#define AUDIO_FREQ          48000
 #define AUDIO_CHANNELS      2
 #define AUDIO_SAMPLESIZE    sizeof(int16_t)
 
+// GPU time per frame dynamic resolution aims for, leaving the rest of the 16.7 ms to
+// the swap and the host.
+#define DYNAMIC_RESOLUTION_TARGET_MS 12.0
+
 
 
 namespace SaveState {
@@ -66,29 +92,14 @@ namespace SaveState {
     };
 } // namespace SaveState
 
-namespace OpenEmuCoreThread {
-    enum class EmuThreadState {
-        DISABLED,
-        START_REQUESTED,
-        RUNNING,
-        PAUSE_REQUESTED,
-        PAUSED,
-        QUIT_REQUESTED,
-        STOPPED,
-    };
-} //namespace OpenEmuThreadCore
-
-void NativeSetThreadState(OpenEmuCoreThread::EmuThreadState threadState);
-
 @interface PPSSPPGameCore () <OEPSPSystemResponderClient, OEAudioBuffer>
 {
     CoreParameter _coreParam;
     bool _isInitialized;
     bool _shouldReset;
-	
-	//Hack for analog stick.
-	float x;
-	float y;
+    dispatch_group_t _fontSyncGroup;
+    // Host FBO size as a multiple of 480x272, above 1 with dynamic resolution.
+    int _maxRenderScale;
 
    OpenEmuGLContext *OEgraphicsContext;
 }
@@ -96,6 +107,47 @@ void NativeSetThreadState(OpenEmuCoreThread::EmuThreadState threadState);
 
 PPSSPPGameCore *_current = 0;
 
+// Copies the bundled fonts to flash0 unless an identical copy is already there, which is
+// what most launches find.
+static void SyncFontFiles(NSURL *sourceDirectory, NSURL *destinationDirectory)
+{
+    OpenEmuStartupTrace::ScopedStep step("Font sync");
+
+    NSFileManager *fileManager = NSFileManager.defaultManager;
+    NSArray *keys = @[NSURLFileSizeKey, NSURLContentModificationDateKey];
+    NSArray *fontFiles = [fileManager contentsOfDirectoryAtURL:sourceDirectory includingPropertiesForKeys:keys options:0 error:nil];
+    [fileManager createDirectoryAtURL:destinationDirectory withIntermediateDirectories:YES attributes:nil error:nil];
+    for(NSURL *fontURL in fontFiles)
+    {
+        NSURL *destinationFontURL = [destinationDirectory URLByAppendingPathComponent:fontURL.lastPathComponent];
+
+        // Copies keep the modification date, same size and date means same file.
+        NSDictionary *sourceValues = [fontURL resourceValuesForKeys:keys error:nil];
+        NSDictionary *destinationValues = [destinationFontURL resourceValuesForKeys:keys error:nil];
+        if(destinationValues && [sourceValues isEqualToDictionary:destinationValues])
+            continue;
+
+        [fileManager removeItemAtURL:destinationFontURL error:nil];
+        [fileManager copyItemAtURL:fontURL toURL:destinationFontURL error:nil];
+    }
+}
+
+// PPSSPP loads the game on its own thread after PSP_InitStart, FinishBoot waits for that
+// and creates the GPU.
+static bool StartBoot(const CoreParameter &coreParam, std::string *error_string)
+{
+    OpenEmuStartupTrace::ScopedStep step("PSP_InitStart");
+    return PSP_InitStart(coreParam, error_string);
+}
+
+static bool FinishBoot(std::string *error_string)
+{
+    OpenEmuStartupTrace::ScopedStep step("PSP_InitUpdate");
+    while(!PSP_InitUpdate(error_string))
+        sleep_ms(1);
+    return PSP_IsInited();
+}
+
 @implementation PPSSPPGameCore
 
 
@@ -115,18 +167,15 @@ PPSSPPGameCore *_current = 0;
     NSURL *resourceURL = self.owner.bundle.resourceURL;
     NSURL *supportDirectoryURL = [NSURL fileURLWithPath:self.supportDirectoryPath isDirectory:YES];
 
-    // Copy over font files if needed
-    NSFileManager *fileManager = NSFileManager.defaultManager;
+    OpenEmuStartupTrace::Begin();
+
+    // Nothing reads the fonts until the game boots, sync them in the background.
     NSURL *fontSourceDirectory = [resourceURL URLByAppendingPathComponent:@"flash0/font" isDirectory:YES];
     NSURL *fontDestinationDirectory = [supportDirectoryURL URLByAppendingPathComponent:@"font" isDirectory:YES];
-    NSArray *fontFiles = [fileManager contentsOfDirectoryAtURL:fontSourceDirectory includingPropertiesForKeys:@[NSURLNameKey] options:0 error:nil];
-    [fileManager createDirectoryAtURL:fontDestinationDirectory withIntermediateDirectories:YES attributes:nil error:nil];
-    for(NSURL *fontURL in fontFiles)
-    {
-        NSURL *destinationFontURL = [fontDestinationDirectory URLByAppendingPathComponent:fontURL.lastPathComponent];
-
-        [fileManager copyItemAtURL:fontURL toURL:destinationFontURL error:nil];
-    }
+    _fontSyncGroup = dispatch_group_create();
+    dispatch_group_async(_fontSyncGroup, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        SyncFontFiles(fontSourceDirectory, fontDestinationDirectory);
+    });
 
     g_Config.bEnableLogging = true;
     g_Config.iFastForwardMode = (int)FastForwardMode::CONTINUOUS;
@@ -142,8 +191,6 @@ PPSSPPGameCore *_current = 0;
 
     LogManager::Init(&g_Config.bEnableLogging);
 
-    g_Config.Load("");
-
     // Force a trailing forward slash that PPSSPP requires
     NSString *directoryString      = [supportDirectoryURL.path stringByAppendingString:@"/"];
     //NSURL *directoryURL3            = [supportDirectoryURL URLByAppendingPathComponent:@"/" isDirectory:YES];
@@ -162,22 +209,82 @@ PPSSPPGameCore *_current = 0;
         LogManager::Init(&g_Config.bEnableLogging);
     }
     
+    // Only load once the directories are set, a load before that finds no ini and every
+    // value it sets gets overwritten here anyway.
     g_Config.SetSearchPath(GetSysDirectory(DIRECTORY_SYSTEM));
-    g_Config.Load();
+    {
+        OpenEmuStartupTrace::ScopedStep step("Config load");
+        g_Config.Load();
+    }
+    OpenEmuShaderCache::Configure();
+    OpenEmuStartupTrace::SetTraceFile(g_Config.appCacheDirectory / "startup_trace.json");
     
     _coreParam.cpuCore      = CPUCore::JIT;
     _coreParam.gpuCore      = GPUCORE_GLES;
     _coreParam.enableSound  = true;
     _coreParam.fileToStart  = Path(romURL.fileSystemRepresentation);
+    OpenEmuFileLoader::RegisterForImage(_coreParam.fileToStart);
     _coreParam.mountIso     = Path();
     _coreParam.startBreak  = false;
     _coreParam.printfEmuLog = false;
     _coreParam.headLess     = false;
 
-    _coreParam.renderWidth  = 480;
-    _coreParam.renderHeight = 272;
-    _coreParam.pixelWidth   = 480;
-    _coreParam.pixelHeight  = 272;
+    // PPSSPP_DYNAMIC_RESOLUTION=4 renders at up to 4x, as much of it as the GPU keeps
+    // under the frame time target, see OpenEmuDynamicResolution.
+    _maxRenderScale = 1;
+    if (const char *maxScale = getenv("PPSSPP_DYNAMIC_RESOLUTION"))
+        _maxRenderScale = MIN(MAX(atoi(maxScale), 1), OpenEmuDynamicResolution::MAX_SCALE);
+    int startScale = MIN(MAX(g_Config.iInternalResolution, 1), _maxRenderScale);
+    if (_maxRenderScale > 1)
+        OpenEmuDynamicResolution::Configure(1, _maxRenderScale, startScale, DYNAMIC_RESOLUTION_TARGET_MS);
+
+    _coreParam.renderWidth  = 480 * startScale;
+    _coreParam.renderHeight = 272 * startScale;
+    _coreParam.pixelWidth   = 480 * _maxRenderScale;
+    _coreParam.pixelHeight  = 272 * _maxRenderScale;
+
+    // os (default), priority or performance, see OpenEmuThreadPlacement. Before NativeInit
+    // starts the workers.
+    OpenEmuThreadPlacement::Policy threadPolicy;
+    if (const char *policyName = getenv("PPSSPP_THREAD_POLICY")) {
+        if (OpenEmuThreadPlacement::ParsePolicy(policyName, &threadPolicy))
+            OpenEmuThreadPlacement::SetPolicy(threadPolicy);
+    }
+
+    // For capture tools, e.g. PPSSPP_FRAME_EXPORT=/ppsspp-frames. Same size as bufferSize.
+    if (const char *exportName = getenv("PPSSPP_FRAME_EXPORT"))
+        OpenEmuFrameExport::Configure(exportName, 480 * _maxRenderScale, 272 * _maxRenderScale);
+
+    // PPSSPP_JIT_CACHE=1 precompiles the blocks earlier sessions of the game compiled, see
+    // OpenEmuJitCache.
+    if (const char *jitCache = getenv("PPSSPP_JIT_CACHE"))
+        OpenEmuJitCache::SetEnabled(atoi(jitCache) != 0);
+
+    // PPSSPP_SHADER_STATS=1 tells shader cache precompiles apart from compiles that stutter,
+    // see OpenEmuShaderCache. The counts get logged when the game stops.
+    if (const char *shaderStats = getenv("PPSSPP_SHADER_STATS"))
+        OpenEmuShaderCache::SetEnabled(atoi(shaderStats) != 0);
+
+    // PPSSPP_MEMORY_BUDGET=512 keeps the process under 512 MB resident by evicting caches,
+    // 0 only accounts. See OpenEmuMemory.
+    if (const char *memoryBudget = getenv("PPSSPP_MEMORY_BUDGET")) {
+        OpenEmuMemory::SetEnabled(true);
+        OpenEmuMemory::SetBudget((uint64_t)MAX(atoi(memoryBudget), 0) * 1024 * 1024);
+    }
+
+    // PPSSPP_RUN_AHEAD=1 shows the reaction to input a frame earlier at the cost of
+    // emulating an extra frame, per title. See OpenEmuRunAhead, the cost gets logged when the
+    // game stops.
+    if (const char *runAhead = getenv("PPSSPP_RUN_AHEAD"))
+        OpenEmuRunAhead::SetFrames(atoi(runAhead));
+
+    // PPSSPP_REWIND=30:64 captures a snapshot every 30 emulated frames into at most 64 MB
+    // (the default), see OpenEmuRewind. The cost and size get logged when the game stops.
+    if (const char *rewind = getenv("PPSSPP_REWIND")) {
+        int interval = 0, budgetMb = 64;
+        if (sscanf(rewind, "%d:%d", &interval, &budgetMb) >= 1 && interval > 0 && budgetMb > 0)
+            OpenEmuRewind::Configure(interval, (size_t)budgetMb * 1024 * 1024);
+    }
 
     coreState = CORE_POWERUP;
     
@@ -188,8 +295,58 @@ PPSSPPGameCore *_current = 0;
 - (void)stopEmulation
 {
     NativeSetThreadState(OpenEmuCoreThread::EmuThreadState::PAUSE_REQUESTED);
+    OpenEmuSaveState::WaitForPendingWrites();
+    OpenEmuShaderCache::OnGameStopped();
+    OpenEmuJitCache::OnGameStopped();
+    OpenEmuInputMovie::Stop();
+
+    if (OpenEmuDynamicResolution::IsEnabled()) {
+        OpenEmuDynamicResolution::Stats dynamic = OpenEmuDynamicResolution::GetStats();
+        NSLog(@"[PPSSPP] Dynamic resolution: %dx at the end, GPU p50 %.2f ms, p99 %.2f ms over %llu frames, %zu changes",
+              dynamic.scale, dynamic.gpuTime.Percentile(50), dynamic.gpuTime.Percentile(99), (unsigned long long)dynamic.frames,
+              dynamic.changes.size());
+        for (int s = OpenEmuDynamicResolution::MIN_SCALE; s <= OpenEmuDynamicResolution::MAX_SCALE; s++) {
+            if (dynamic.framesAtScale[s] > 0)
+                NSLog(@"[PPSSPP]   %dx: %llu frames, GPU %.2f ms mean, %llu over the target", s, (unsigned long long)dynamic.framesAtScale[s],
+                      dynamic.meanGpuMsAtScale[s], (unsigned long long)dynamic.overBudgetAtScale[s]);
+        }
+        for (const OpenEmuDynamicResolution::Change &change : dynamic.changes) {
+            if (change.from != 0)
+                NSLog(@"[PPSSPP]   %dx -> %dx at frame %llu, GPU %.2f ms before, %.2f ms after", change.from, change.to,
+                      (unsigned long long)change.frame, change.gpuMsBefore, change.gpuMsAfter);
+        }
+    }
+    OpenEmuInflightFrames::Stats inflight = OpenEmuInflightFrames::GetStats();
+    if (OpenEmuInflightFrames::IsEnabled() && inflight.frames > 0) {
+        NSLog(@"[PPSSPP] In-flight frames: depth %d, %llu misses in %llu frames, latency p50 %.1f ms, p99 %.1f ms, %zu decisions",
+              inflight.depth, (unsigned long long)inflight.misses, (unsigned long long)inflight.frames,
+              inflight.latency.Percentile(50), inflight.latency.Percentile(99), inflight.decisions.size());
+        for (int d = OpenEmuInflightFrames::MIN_DEPTH; d <= OpenEmuInflightFrames::MAX_DEPTH; d++) {
+            if (inflight.framesAtDepth[d] > 0)
+                NSLog(@"[PPSSPP]   depth %d: %llu frames, %llu misses, %.1f ms latency", d, (unsigned long long)inflight.framesAtDepth[d],
+                      (unsigned long long)inflight.missesAtDepth[d], inflight.meanLatencyMsAtDepth[d]);
+        }
+    }
+    if (OpenEmuShaderCache::IsEnabled()) {
+        OpenEmuShaderCache::Stats shaders = OpenEmuShaderCache::GetStats();
+        NSLog(@"[PPSSPP] Shaders: %llu precompiled, %llu hits, %llu misses, compiled in %llu frames, %.1f ms (%.3f ms max)",
+              (unsigned long long)shaders.precompiled, (unsigned long long)shaders.hits, (unsigned long long)shaders.misses,
+              (unsigned long long)shaders.compileFrames, shaders.compileMs, shaders.maxCompileFrameMs);
+    }
+    if (OpenEmuRunAhead::GetFrames() > 0) {
+        OpenEmuRunAhead::Stats runAhead = OpenEmuRunAhead::GetStats();
+        NSLog(@"[PPSSPP] Run-ahead: %d frames, real frame %.3f ms, +%.3f ms per host frame (%.3f ms per speculative frame)",
+              runAhead.frames, runAhead.realFrameMs, runAhead.extraMs, runAhead.speculativeFrameMs);
+    }
+    OpenEmuRewind::Stats rewind = OpenEmuRewind::GetStats();
+    if (rewind.intervalFrames > 0) {
+        NSLog(@"[PPSSPP] Rewind: %u snapshots, %.1f MB of %.1f MB, %.1f KB per delta, capture %.3f ms/frame spread",
+              rewind.snapshots, rewind.memoryBytes / 1048576.0, rewind.budgetBytes / 1048576.0,
+              rewind.averageSnapshotBytes / 1024.0, rewind.captureCostPerFrameMs);
+    }
 
     PSP_Shutdown();
+    OpenEmuAudio::Shutdown();
 
     NativeShutdownGraphics();
     NativeShutdown();
@@ -204,6 +361,9 @@ PPSSPPGameCore *_current = 0;
 
 - (void)executeFrame
 {
+    std::string error_string;
+    bool booting = false;
+
     if(!_isInitialized)
     {
         // This is where PPSSPP will look for ppge_atlas.zim, requires trailing forward slash
@@ -216,14 +376,28 @@ PPSSPPGameCore *_current = 0;
         OEgraphicsContext->InitFromRenderThread(nullptr);
         
         _coreParam.graphicsContext = OEgraphicsContext;
-       
+
+        // The game needs its fonts from here on.
+        dispatch_group_wait(_fontSyncGroup, DISPATCH_TIME_FOREVER);
+
+        // The game loads on PPSSPP's loader thread while graphics and audio come up here.
+        booting = StartBoot(_coreParam, &error_string);
+
         NativeInitGraphics(OEgraphicsContext);
+
+        // The emu thread mixes into this after every frame, the audio callback only reads from it.
+        OpenEmuAudio::Init(AUDIO_FREQ, AudioResampler::Quality::SINC);
     }
 
     if(_shouldReset)
     {
         NativeSetThreadState(OpenEmuCoreThread::EmuThreadState::PAUSE_REQUESTED);
+        OpenEmuShaderCache::OnGameStopped();
+        OpenEmuJitCache::OnGameStopped();
+        OpenEmuInputMovie::Stop();
         PSP_Shutdown();
+        OpenEmuRewind::Clear();
+        booting = StartBoot(_coreParam, &error_string);
     }
 
     if(!_isInitialized || _shouldReset)
@@ -231,9 +405,25 @@ PPSSPPGameCore *_current = 0;
         _isInitialized = YES;
         _shouldReset = NO;
 
-        std::string error_string;
-        if(!PSP_Init(_coreParam, &error_string))
+        if(!booting || !FinishBoot(&error_string))
             NSLog(@"[PPSSPP] ERROR: %s", error_string.c_str());
+        OpenEmuShaderCache::OnGameStarted();
+        OpenEmuJitCache::OnGameStarted();
+        OpenEmuInflightFrames::Reset(g_Config.iInflightFrames);
+
+        // PPSSPP_GE_DUMP=10 records ten frames into PSP/SYSTEM/DUMP for replaying, see
+        // OpenEmuGeDump.
+        if (const char *dumpFrames = getenv("PPSSPP_GE_DUMP"))
+            OpenEmuGeDump::Start(GetSysDirectory(DIRECTORY_DUMP), atoi(dumpFrames));
+
+        // Input movies for repeatable runs, see OpenEmuInputMovie. Each reset starts over.
+        std::string movieError;
+        if (const char *recordMovie = getenv("PPSSPP_RECORD_MOVIE")) {
+            OpenEmuInputMovie::StartRecording(Path(recordMovie));
+        } else if (const char *replayMovie = getenv("PPSSPP_REPLAY_MOVIE")) {
+            if (!OpenEmuInputMovie::StartReplay(Path(replayMovie), &movieError))
+                NSLog(@"[PPSSPP] Can't replay movie: %s", movieError.c_str());
+        }
 
         host->BootDone();
 		host->UpdateDisassembly();
@@ -256,8 +446,8 @@ PPSSPPGameCore *_current = 0;
         NativeSetThreadState(OpenEmuCoreThread::EmuThreadState::START_REQUESTED);
         
     } else {
-        //If Fast forward rate is detected, unthrottle the rndering
-        PSP_CoreParameter().fastForward = (self.rate > 1) ? true : false;
+        // Fast-forward runs several emulated frames per presented one, see OpenEmuFastForward.
+        OpenEmuFastForward::SetSpeed(OpenEmuFastForward::SpeedForRate(self.rate));
 
         //Let PPSSPP Core run a loop and return
         UpdateRunLoop();
@@ -272,7 +462,8 @@ PPSSPPGameCore *_current = 0;
 
 - (OEIntSize)bufferSize
 {
-    return OEIntSizeMake(480, 272);
+    int scale = MAX(_maxRenderScale, 1);
+    return OEIntSizeMake(480 * scale, 272 * scale);
 }
 
 - (OEIntSize)aspectSize
@@ -304,8 +495,7 @@ PPSSPPGameCore *_current = 0;
 
 - (NSUInteger)read:(void *)buffer maxLength:(NSUInteger)len
 {
-    NativeMix((short *)buffer, (int)(len / (AUDIO_CHANNELS * sizeof(uint16_t))));
-    return len;
+    return OpenEmuAudio::Consume(buffer, len);
 }
 
 - (NSUInteger)write:(const void *)buffer maxLength:(NSUInteger)length
@@ -315,20 +505,11 @@ PPSSPPGameCore *_current = 0;
 
 - (NSUInteger)length
 {
-    return AUDIO_FREQ / 15;
+    return OpenEmuAudio::TargetBufferBytes();
 }
 
 # pragma mark - Save States
 
-static void _OESaveStateCallback(SaveState::Status status, std::string message, void *cbUserData)
-{
-    void (^block)(BOOL, NSError *) = (__bridge_transfer void(^)(BOOL, NSError *))cbUserData;
-
-    [_current endPausedExecution];
-    
-    block((status != SaveState::Status::FAILURE), nil);
-}
-
 static void _OELoadStateCallback(SaveState::Status status, std::string message, void *cbUserData)
 {
     void (^block)(BOOL, NSError *) = (__bridge_transfer void(^)(BOOL, NSError *))cbUserData;
@@ -354,16 +535,33 @@ static void _OELoadStateCallback(SaveState::Status status, std::string message,
 
 - (void)saveStateToFileAtPath:(NSString *)fileName completionHandler:(void (^)(BOOL, NSError *))block
 {
-    [self beginPausedExecution];
-    SaveState::Save(Path(fileName.fileSystemRepresentation),0, _OESaveStateCallback, (__bridge_retained void *)[block copy]);
+    // Emulation only stops while the state is copied out of the core, the file gets
+    // compressed and written in the background.
+    void (^callback)(BOOL, NSError *) = [block copy];
+    OpenEmuSaveState::SaveAsync(Path(fileName.fileSystemRepresentation), [callback](bool success, const OpenEmuSaveState::Timing &timing) {
+        NSError *error = nil;
+        if(!success) {
+            error = [NSError errorWithDomain:OEGameCoreErrorDomain code:OEGameCoreCouldNotSaveStateError userInfo:@{
+                NSLocalizedDescriptionKey : NSLocalizedString(@"The Save State failed to Save", @"PPSSPP Save State Failure description."),
+                NSLocalizedRecoverySuggestionErrorKey : [NSString stringWithFormat:NSLocalizedString(@"Could not save Save State.", @"PPSSPP Save State Failure.")]
+            }];
+        }
+        callback(success, error);
+    });
 }
 
 - (void)loadStateFromFileAtPath:(NSString *)fileName completionHandler:(void (^)(BOOL, NSError *))block
 {
+    // Rewind history from before the load would step back into a different timeline.
+    OpenEmuRewind::Clear();
+    // The state may still be on its way to disk.
+    OpenEmuSaveState::WaitForPendingWrites();
     SaveState::Load(Path(fileName.fileSystemRepresentation), 0,_OELoadStateCallback, (__bridge_retained void *)[block copy]);
     if(_isInitialized){
         //We need to pause our EmuThread so we don't try to process the save state in the middle of a Frame Render
         NativeSetThreadState(OpenEmuCoreThread::EmuThreadState::PAUSE_REQUESTED);
+        // A loaded state is a different timeline, a movie being recorded ends here.
+        OpenEmuInputMovie::Stop();
 
         SaveState::Process();
     }
@@ -375,21 +573,21 @@ const int buttonMap[] = { CTRL_UP, CTRL_DOWN, CTRL_LEFT, CTRL_RIGHT, 0, 0, 0, 0,
 
 - (oneway void)didMovePSPJoystickDirection:(OEPSPButton)button withValue:(CGFloat)value forPlayer:(NSUInteger)player
 {
+    // Applied by the emu thread at the next frame boundary.
     if(button == OEPSPAnalogUp || button == OEPSPAnalogDown)
-        y = (button == OEPSPAnalogUp ? value : -value);
+        OpenEmuInput::PushAnalog(1, button == OEPSPAnalogUp ? value : -value);
     else
-        x = (button == OEPSPAnalogRight ? value : -value);
-	__CtrlSetAnalogXY(0, x, y);
+        OpenEmuInput::PushAnalog(0, button == OEPSPAnalogRight ? value : -value);
 }
 
 - (oneway void)didPushPSPButton:(OEPSPButton)button forPlayer:(NSUInteger)player
 {
-    __CtrlButtonDown(buttonMap[button]);
+    OpenEmuInput::PushButton(buttonMap[button], true);
 }
 
 - (oneway void)didReleasePSPButton:(OEPSPButton)button forPlayer:(NSUInteger)player
 {
-    __CtrlButtonUp(buttonMap[button]);
+    OpenEmuInput::PushButton(buttonMap[button], false);
 }
 
 @end